@@ -10,6 +10,9 @@
 #include "acutest.h"
 #include <iostream>
 #include <limits>
+#include <vector>
+#include <unordered_set>
+#include <map>
 
 
 void test_case_1() 
@@ -417,6 +420,1513 @@ void test_val()
     }
 }
 
+void test_pow()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::PadicNumber x(ctx);
+    x.set(static_cast<flint::unsigned_long_t>(3));
+
+    flint::Fmpz e;
+    e.set(static_cast<flint::unsigned_long_t>(5));
+    TEST_CHECK(flint::pow(x, e).toString(flint::PadicPrintMode::TERSE) == "243");
+
+    e.set(static_cast<flint::signed_long_t>(-3));
+    auto x_inv = flint::pow(x, e);
+    auto one = x_inv * x * x * x;
+    TEST_CHECK(one.toString(flint::PadicPrintMode::TERSE) == "1");
+
+    // 7 * 7^20 is beyond the precision
+    flint::PadicNumber y(ctx);
+    y.set(static_cast<flint::unsigned_long_t>(7));
+    e.set(static_cast<flint::unsigned_long_t>(20));
+    TEST_CHECK(flint::pow(y, e).toString(flint::PadicPrintMode::TERSE) == "0");
+
+    // p-adic exponents on the principal unit 8 = 1 + 7
+    x.set(static_cast<flint::unsigned_long_t>(8));
+
+    flint::PadicNumber a(ctx);
+    a.set(static_cast<flint::unsigned_long_t>(49));
+    e.set(static_cast<flint::unsigned_long_t>(49));
+    TEST_CHECK(flint::pow(x, a).toString(flint::PadicPrintMode::TERSE) == flint::pow(x, e).toString(flint::PadicPrintMode::TERSE));
+
+    a.set(static_cast<flint::unsigned_long_t>(123456789));
+    e.set(static_cast<flint::unsigned_long_t>(123456789));
+    TEST_CHECK(flint::pow(x, a).toString(flint::PadicPrintMode::TERSE) == flint::pow(x, e).toString(flint::PadicPrintMode::TERSE));
+
+    // 1000000007^4 reduced mod 7^20 fits into a word and goes through pow(x, Fmpz)
+    flint::Fmpz b;
+    b.set(static_cast<flint::unsigned_long_t>(1000000007));
+    auto b4 = b * b * b * b;
+    a.set(static_cast<flint::unsigned_long_t>(1000000007));
+    auto a4 = a * a * a * a;
+    auto z = flint::pow(x, a4);
+    TEST_CHECK(z.toString(flint::PadicPrintMode::TERSE) == flint::pow(x, b4).toString(flint::PadicPrintMode::TERSE));
+
+    // at precision 40 it stays wider than a word and goes through exp(a·log(x))
+    flint::Fmpz den, m;
+    den.set(static_cast<flint::unsigned_long_t>(1));
+    flint::Fmpq q;
+    q.set(b4, den);
+    flint::PadicNumber a40(ctx, 40), x40(ctx, 40);
+    a40.set(q);
+    x40.set(static_cast<flint::unsigned_long_t>(8));
+    fmpz_pow_ui(m.get(), p.get(), 40);
+    fmpz_mod(m.get(), b4.get(), m.get());
+    TEST_CHECK(fmpz_bits(m.get()) > FLINT_BITS);
+    TEST_CHECK(flint::pow(x40, a40, 40) == flint::pow(x40, b4, 40));
+
+    a.set(static_cast<flint::unsigned_long_t>(7 * 7 * 7 * 7));
+    TEST_CHECK(flint::pow(x, a, 4).toString(flint::PadicPrintMode::TERSE) == "1");
+
+    y.set(static_cast<flint::unsigned_long_t>(3));
+    TEST_EXCEPTION(flint::pow(y, a), std::domain_error);
+
+    std::cout << "8^(1000000007^4) mod 7^20 = " << z << "\n";
+    std::cout << "\n";
+}
+
+void test_shift()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::PadicNumber x(ctx, 10);
+    x.set(static_cast<flint::unsigned_long_t>(3));
+
+    auto y = x << 2;
+    TEST_CHECK(y.toString(flint::PadicPrintMode::TERSE) == "147");
+    TEST_CHECK(y.val() == 2);
+    TEST_CHECK(y.prec() == 12);
+
+    auto z = y >> 3;
+    TEST_CHECK(z.toString(flint::PadicPrintMode::TERSE) == "3/7");
+    TEST_CHECK(z.val() == -1);
+    TEST_CHECK(z.prec() == 9);
+
+    x <<= 1;
+    x >>= 1;
+    TEST_CHECK(x.toString(flint::PadicPrintMode::TERSE) == "3");
+    TEST_CHECK(x.prec() == 10);
+
+    flint::PadicNumber zero(ctx, 10);
+    zero <<= 5;
+    TEST_CHECK(zero.val() == 0);
+    TEST_CHECK(zero.prec() == 15);
+}
+
+void test_scalar()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::PadicNumber x(ctx, 10);
+    x.set(static_cast<flint::unsigned_long_t>(10));
+
+    TEST_CHECK((x * 3).toString(flint::PadicPrintMode::TERSE) == "30");
+    TEST_CHECK((x * 7).val() == 1);
+    TEST_CHECK((x + 1).toString(flint::PadicPrintMode::TERSE) == "11");
+    TEST_CHECK((x / 7).toString(flint::PadicPrintMode::TERSE) == "10/7");
+    TEST_CHECK((0 * x).toString(flint::PadicPrintMode::TERSE) == "0");
+    TEST_EXCEPTION(x / 0, std::domain_error);
+
+    // every scalar operation agrees with the PadicNumber one, for units, multiples of p and fractions
+    const flint::signed_long_t scalars[] = { 1, -1, 3, -5, 7, 49, -98, 123456789 };
+    for(int shift = -2; shift <= 2; shift++)
+    {
+        auto y = x << shift;
+        for(auto c : scalars)
+        {
+            // scalars are exact, so the reference operand needs room for the negative valuations
+            flint::PadicNumber c_padic(ctx, 40);
+            c_padic.set(c);
+
+            flint::Fmpz c_fmpz;
+            c_fmpz.set(c);
+
+            TEST_CHECK((y + c).toString(flint::PadicPrintMode::TERSE) == (y + c_padic).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((c + y).toString(flint::PadicPrintMode::TERSE) == (c_padic + y).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((y - c).toString(flint::PadicPrintMode::TERSE) == (y - c_padic).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((c - y).toString(flint::PadicPrintMode::TERSE) == (c_padic - y).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((y * c).toString(flint::PadicPrintMode::TERSE) == (y * c_padic).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((y / c).toString(flint::PadicPrintMode::TERSE) == (y / c_padic).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((c / y).toString(flint::PadicPrintMode::TERSE) == (c_padic / y).toString(flint::PadicPrintMode::TERSE));
+
+            TEST_CHECK((y - c_fmpz).toString(flint::PadicPrintMode::TERSE) == (y - c_padic).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((c_fmpz * y).toString(flint::PadicPrintMode::TERSE) == (c_padic * y).toString(flint::PadicPrintMode::TERSE));
+            TEST_CHECK((y / c_fmpz).toString(flint::PadicPrintMode::TERSE) == (y / c_padic).toString(flint::PadicPrintMode::TERSE));
+
+            if(c > 0)
+            {
+                auto u = static_cast<flint::unsigned_long_t>(c);
+                TEST_CHECK((y - u).toString(flint::PadicPrintMode::TERSE) == (y - c_padic).toString(flint::PadicPrintMode::TERSE));
+                TEST_CHECK((u - y).toString(flint::PadicPrintMode::TERSE) == (c_padic - y).toString(flint::PadicPrintMode::TERSE));
+            }
+        }
+    }
+}
+
+void test_dot()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(5));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    std::vector<flint::PadicNumber> a;
+    std::vector<flint::PadicNumber> b;
+    for(flint::signed_long_t i = 1; i <= 50; i++)
+    {
+        flint::PadicNumber ai(ctx);
+        ai.set(i * i - 7);
+        a.push_back(ai >> (i % 3));
+
+        flint::PadicNumber bi(ctx);
+        bi.set(3 * i + 1);
+        b.push_back(bi);
+    }
+
+    flint::PadicNumber expected(ctx);
+    for(std::size_t i = 0; i < a.size(); i++)
+    {
+        expected = expected + a[i] * b[i];
+    }
+    auto d = flint::dot(a, b);
+    TEST_CHECK(d.toString(flint::PadicPrintMode::TERSE) == expected.toString(flint::PadicPrintMode::TERSE));
+    TEST_CHECK(d.val() == expected.val());
+
+    flint::PadicNumber alpha(ctx);
+    alpha.set(static_cast<flint::signed_long_t>(-10));
+
+    std::vector<flint::PadicNumber> y(b);
+    flint::axpy(alpha, a, y);
+    for(std::size_t i = 0; i < a.size(); i++)
+    {
+        auto yi = alpha * a[i] + b[i];
+        TEST_CHECK(y[i].toString(flint::PadicPrintMode::TERSE) == yi.toString(flint::PadicPrintMode::TERSE));
+        TEST_CHECK(flint::fma(alpha, a[i], b[i]).toString(flint::PadicPrintMode::TERSE) == yi.toString(flint::PadicPrintMode::TERSE));
+    }
+
+    // 5 * 5 - 25 cancels completely
+    flint::PadicNumber five(ctx);
+    five.set(static_cast<flint::unsigned_long_t>(5));
+    flint::PadicNumber minus_25(ctx);
+    minus_25.set(static_cast<flint::signed_long_t>(-25));
+    TEST_CHECK(flint::fma(five, five, minus_25).toString(flint::PadicPrintMode::TERSE) == "0");
+}
+
+void test_accumulator()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(3));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    // Σ ±k/3^(k mod 4), small limb threshold so that intermediate reductions happen too
+    flint::PadicAccumulator acc(ctx, -3, PADIC_DEFAULT_PREC, 1);
+    flint::PadicNumber expected(ctx);
+    for(flint::signed_long_t k = 1; k <= 2000; k++)
+    {
+        flint::PadicNumber x(ctx);
+        x.set(k * k * k * k * k);
+        auto term = x >> (k % 4);
+        if(k % 5 == 0)
+        {
+            acc -= term;
+            expected = expected - term;
+        }
+        else
+        {
+            acc += term;
+            expected = expected + term;
+        }
+    }
+    auto sum = acc.value();
+    TEST_CHECK(sum.toString(flint::PadicPrintMode::TERSE) == expected.toString(flint::PadicPrintMode::TERSE));
+    TEST_CHECK(sum.val() == expected.val());
+
+    flint::PadicNumber x(ctx);
+    x.set(static_cast<flint::unsigned_long_t>(1));
+    TEST_EXCEPTION(acc += (x >> 4), std::domain_error);
+
+    acc.reset();
+    TEST_CHECK(acc.value().toString(flint::PadicPrintMode::TERSE) == "0");
+}
+
+void test_invert_batch()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    std::vector<flint::PadicNumber> x;
+    std::vector<std::string> expected;
+    for(flint::signed_long_t i = 0; i < 30; i++)
+    {
+        flint::PadicNumber xi(ctx);
+        xi.set(i * 7 - 100);
+        x.push_back(i % 5 < 2 ? xi / (i % 5 == 0 ? 49 : 7) : xi * (i % 5 == 2 ? 1 : i % 5 == 3 ? 7 : 49));
+        expected.push_back((1 / x.back()).toString(flint::PadicPrintMode::TERSE));
+    }
+
+    flint::PadicNumber tiny(ctx);
+    tiny.set(static_cast<flint::unsigned_long_t>(1));
+    x.push_back(tiny >> 25);
+    x.push_back(flint::PadicNumber(ctx));
+
+    auto status = flint::invert_batch(x);
+    for(std::size_t i = 0; i < expected.size(); i++)
+    {
+        TEST_CHECK(status[i] == flint::PadicInvertStatus::OK);
+        TEST_CHECK(x[i].toString(flint::PadicPrintMode::TERSE) == expected[i]);
+    }
+    TEST_CHECK(status[30] == flint::PadicInvertStatus::LOW_PRECISION);
+    TEST_CHECK(x[30].toString(flint::PadicPrintMode::TERSE) == "0");
+    TEST_CHECK(status[31] == flint::PadicInvertStatus::ZERO);
+}
+
+void test_hash()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::PadicNumber x(ctx, 20);
+    x.set(static_cast<flint::unsigned_long_t>(1 + 282475249)); // 1 + 7^10
+    flint::PadicNumber y(ctx, 10);
+    y.set(static_cast<flint::unsigned_long_t>(1));
+    TEST_CHECK(!(x == y));
+    TEST_CHECK(!flint::equal(x, y, 11));
+    TEST_CHECK(flint::equal(x, y, 10));
+    TEST_CHECK(!flint::equal(x, y + 1, 10));
+
+    // == and std::hash see the exact representation, precision included
+    flint::PadicNumber z1(ctx, 10), z2(ctx, 10);
+    z1.set(static_cast<flint::unsigned_long_t>(1 + 282475249));
+    z2.set(static_cast<flint::unsigned_long_t>(1 + 2 * 282475249));
+    TEST_CHECK(z1 == y && z2 == y);
+    TEST_CHECK(std::hash<flint::PadicNumber>{}(z1) == std::hash<flint::PadicNumber>{}(y));
+    TEST_CHECK(std::hash<flint::PadicNumber>{}(z2) == std::hash<flint::PadicNumber>{}(y));
+    TEST_CHECK(flint::PadicBallHash{10}(x) == flint::PadicBallHash{10}(y));
+
+    // 2000 integers fall into 7^3 balls of radius 7^-3
+    std::unordered_set<flint::PadicNumber, flint::PadicBallHash, flint::PadicBallEqual> balls(16, flint::PadicBallHash{3}, flint::PadicBallEqual{3});
+    std::unordered_set<flint::PadicNumber> values;
+    for(flint::signed_long_t i = 0; i < 2000; i++)
+    {
+        flint::PadicNumber z(ctx);
+        z.set(i % 1000);
+        balls.insert(z);
+        values.insert(z);
+        TEST_CHECK(flint::hash(z, 3) == flint::hash(z * 2402 + 7 * 7 * 7 * i, 3)); // 2402 ≡ 1 mod 7^4
+    }
+    TEST_CHECK(balls.size() == 343);
+    TEST_CHECK(values.size() == 1000);
+
+    std::unordered_set<flint::Fmpz> big;
+    flint::Fmpz b;
+    b.set(static_cast<flint::unsigned_long_t>(1000000007));
+    for(int i = 0; i < 3; i++)
+    {
+        big.insert(b * b * b);
+        big.insert(b * b * b * b);
+    }
+    TEST_CHECK(big.size() == 2);
+}
+
+void test_ball_index()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    std::vector<flint::PadicNumber> xs;
+    for(flint::signed_long_t i = 0; i < 300; i++)
+    {
+        flint::PadicNumber x(ctx, 12);
+        x.set((i * 7919) % 5000 - 2500);
+        xs.push_back(i % 5 == 0 ? x / 49 : x);
+    }
+
+    flint::PadicBallIndex bulk(ctx, 12, -2);
+    flint::PadicBallIndex single(ctx, 12, -2);
+    bulk.insert(std::span<const flint::PadicNumber>(xs), 4);
+    for(const auto& x : xs)
+    {
+        single.insert(x);
+    }
+    TEST_CHECK(bulk.size() == xs.size());
+
+    for(std::size_t i = 0; i < xs.size(); i += 7)
+    {
+        for(flint::signed_long_t k = -3; k <= 13; k += 2)
+        {
+            std::vector<std::size_t> expected;
+            for(std::size_t j = 0; j < xs.size(); j++)
+            {
+                if(flint::equal(xs[i], xs[j], std::min<flint::signed_long_t>(k, 12)))
+                {
+                    expected.push_back(j);
+                }
+            }
+            auto a = bulk.ball(xs[i], k);
+            auto b = single.ball(xs[i], k);
+            std::sort(a.begin(), a.end());
+            std::sort(b.begin(), b.end());
+            TEST_CHECK(a == expected);
+            TEST_CHECK(b == expected);
+            TEST_CHECK(bulk.count(xs[i], k) == expected.size());
+        }
+    }
+
+    flint::PadicNumber y(ctx, 12);
+    y.set(static_cast<flint::signed_long_t>(-2500 + 7 * 7 * 7));
+    auto [k, ids] = bulk.nearest(y);
+    TEST_CHECK(k >= 3);
+    TEST_CHECK(!ids.empty());
+    for(auto id : ids)
+    {
+        TEST_CHECK(flint::equal(bulk.at(id), y, k));
+    }
+    TEST_CHECK(bulk.ball(y, k + 1).empty());
+}
+
+void test_ultrametric_tree()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(5));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    std::vector<flint::PadicNumber> xs;
+    for(flint::signed_long_t i = 0; i < 200; i++)
+    {
+        flint::PadicNumber x(ctx, 10);
+        x.set((i * 4099) % 3000 - 1500);
+        xs.push_back(i % 3 == 0 ? x / 5 : x);
+    }
+
+    flint::PadicUltrametricTree tree(ctx, xs, 10, -1, 4);
+    TEST_CHECK(tree.size() == xs.size());
+    TEST_CHECK(tree.members(tree.root()).size() == xs.size());
+
+    auto brute = [&](std::size_t i, std::size_t j)
+    {
+        flint::signed_long_t k = 10;
+        while(!flint::equal(xs[i], xs[j], k))
+        {
+            k--;
+        }
+        return k;
+    };
+
+    std::vector<std::size_t> rows{ 0, 3, 17, 42, 199 };
+    std::vector<std::size_t> cols(xs.size());
+    for(std::size_t j = 0; j < cols.size(); j++)
+    {
+        cols[j] = j;
+    }
+    auto block = tree.block(rows, cols, 3);
+    for(std::size_t r = 0; r < rows.size(); r++)
+    {
+        for(std::size_t j = 0; j < cols.size(); j++)
+        {
+            TEST_CHECK(block[r * cols.size() + j] == brute(rows[r], j));
+        }
+    }
+
+    // every cluster is a ball and its children are strictly smaller balls
+    std::size_t leaves = 0;
+    for(std::size_t c = 0; c < tree.clusterCount(); c++)
+    {
+        const auto& cl = tree.cluster(c);
+        auto members = tree.members(c);
+        for(auto m : members)
+        {
+            TEST_CHECK(tree.valuation(members[0], m) >= cl.val);
+        }
+        std::size_t total = 0;
+        for(auto child : cl.children)
+        {
+            TEST_CHECK(tree.cluster(child).parent == c);
+            TEST_CHECK(tree.cluster(child).val > cl.val || cl.val == 10);
+            total += tree.members(child).size();
+        }
+        if(cl.children.empty())
+        {
+            leaves++;
+        }
+        else
+        {
+            TEST_CHECK(total == members.size());
+            TEST_CHECK(cl.children.size() >= 2);
+        }
+    }
+    TEST_CHECK(leaves == xs.size());
+
+    auto balls = tree.cut(2);
+    for(std::size_t b = 0; b + 1 < balls.size(); b++)
+    {
+        auto order = tree.order();
+        TEST_CHECK(tree.valuation(order[balls[b]], order[balls[b + 1] - 1]) >= 2);
+        if(balls[b + 1] < xs.size())
+        {
+            TEST_CHECK(tree.valuation(order[balls[b]], order[balls[b + 1]]) < 2);
+        }
+    }
+}
+
+void test_radix_sort()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    // integers modulo 7^6 and their valuations and digits, computed by hand
+    const flint::signed_long_t modulus = 117649;
+    std::vector<flint::PadicNumber> xs;
+    std::vector<std::vector<flint::signed_long_t>> keys;
+    for(flint::signed_long_t i = 0; i < 5000; i++)
+    {
+        const flint::signed_long_t a = (i * 104729) % 300000 - 150000;
+        flint::PadicNumber x(ctx, 6);
+        x.set(a);
+        xs.push_back(x);
+
+        flint::signed_long_t r = ((a % modulus) + modulus) % modulus;
+        std::vector<flint::signed_long_t> key{ 6 };
+        if(r != 0)
+        {
+            key[0] = 0;
+            while(r % 7 == 0)
+            {
+                r /= 7;
+                key[0]++;
+            }
+        }
+        for(int j = 0; j < 6; j++)
+        {
+            key.push_back(r % 7);
+            r /= 7;
+        }
+        keys.push_back(key);
+    }
+    std::vector<std::size_t> expected(xs.size());
+    for(std::size_t i = 0; i < expected.size(); i++)
+    {
+        expected[i] = i;
+    }
+    std::stable_sort(expected.begin(), expected.end(), [&keys](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+
+    auto order = flint::radix_order(xs, 6, 4);
+    TEST_CHECK(order == expected);
+    TEST_CHECK(flint::radix_order(xs, 6, 1) == expected);
+
+    auto sorted = xs;
+    flint::radix_sort(sorted, 6, 4);
+    flint::PadicSortKey sortKey(ctx, 6);
+    for(std::size_t i = 0; i < sorted.size(); i++)
+    {
+        TEST_CHECK(flint::equal(sorted[i], xs[expected[i]], 6));
+        if(i > 0)
+        {
+            TEST_CHECK(sortKey(sorted[i - 1]) <= sortKey(sorted[i]));
+        }
+    }
+}
+
+void test_random()
+{
+    // known answers of the Random123 reference implementation
+    auto zero = flint::PadicRandom::philox({ 0, 0, 0, 0 }, { 0, 0 });
+    TEST_CHECK(zero == (flint::PadicRandom::Block{ 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 }));
+    auto ones = flint::PadicRandom::philox({ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0xffffffff, 0xffffffff });
+    TEST_CHECK(ones == (flint::PadicRandom::Block{ 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd }));
+
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::PadicRandom rng(12345);
+    std::vector<flint::PadicNumber> a(7000, flint::PadicNumber(ctx, 40));
+    std::vector<flint::PadicNumber> b(7000, flint::PadicNumber(ctx, 40));
+    rng.fill(a, 0, 0, 1);
+    rng.fill(b, 0, 0, 4);
+    std::vector<int> counts(7, 0);
+    for(std::size_t i = 0; i < a.size(); i++)
+    {
+        TEST_CHECK(flint::equal(a[i], b[i], 40));
+        for(flint::signed_long_t c = 0; c < 7; c++)
+        {
+            flint::PadicNumber d(ctx);
+            d.set(c);
+            if(flint::equal(a[i], d, 1))
+            {
+                counts[c]++;
+            }
+        }
+    }
+    for(auto c : counts)
+    {
+        TEST_CHECK(c > 850 && c < 1150);
+    }
+
+    // a window of the stream, in a smaller ball
+    std::vector<flint::PadicNumber> window(100, flint::PadicNumber(ctx, 40));
+    rng.fill(window, 0, 500);
+    for(std::size_t i = 0; i < window.size(); i++)
+    {
+        TEST_CHECK(flint::equal(window[i], a[500 + i], 40));
+    }
+    rng.fill(window, 3);
+    for(auto& x : window)
+    {
+        TEST_CHECK(x.val() >= 3);
+        TEST_CHECK(x.prec() == 40);
+    }
+    TEST_CHECK(!flint::equal(window[0], window[1], 40));
+}
+
+void test_fmpq()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::Fmpq q;
+    q.set(static_cast<flint::signed_long_t>(-3 * 343), static_cast<flint::unsigned_long_t>(49 * 10));
+    TEST_CHECK(q.toString(flint::Base(10)) == "-21/10");
+    TEST_CHECK(q.denominator().toString(flint::Base(10)) == "10");
+
+    flint::PadicNumber x(ctx, 20);
+    x.set(q);
+    flint::PadicNumber a(ctx, 40), b(ctx, 40);
+    a.set(static_cast<flint::signed_long_t>(-21));
+    b.set(static_cast<flint::signed_long_t>(10));
+    TEST_CHECK(x.val() == 1);
+    TEST_CHECK(flint::equal(x, a / b, 20));
+
+    // many numerators over a few large denominators, some divisible by p
+    flint::Fmpz big;
+    big.set(static_cast<flint::unsigned_long_t>(1000000007));
+    std::vector<flint::Fmpz> dens(3);
+    dens[0] = big * big;
+    dens[1].set(static_cast<flint::unsigned_long_t>(49 * 12345));
+    dens[2].set(static_cast<flint::unsigned_long_t>(1));
+
+    std::vector<flint::Fmpq> qs;
+    std::vector<flint::Fmpz> nums;
+    for(flint::signed_long_t i = -30; i < 30; i++)
+    {
+        flint::Fmpz n;
+        n.set(i * 7);
+        n = n * big * big * big;
+        nums.push_back(n);
+        flint::Fmpq r;
+        r.set(n, dens[(i + 30) % 3]);
+        qs.push_back(r);
+    }
+
+    std::vector<flint::PadicNumber> xs(qs.size(), flint::PadicNumber(ctx, 25));
+    flint::set_batch(xs, qs);
+    for(std::size_t i = 0; i < qs.size(); i++)
+    {
+        flint::PadicNumber y(ctx, 25);
+        y.set(qs[i]);
+        TEST_CHECK(flint::equal(xs[i], y, 25));
+        TEST_CHECK(xs[i].val() == y.val());
+    }
+
+    std::vector<flint::PadicNumber> ys(nums.size(), flint::PadicNumber(ctx, 15));
+    flint::set_batch(ys, nums, dens[1]);
+    for(std::size_t i = 0; i < nums.size(); i++)
+    {
+        flint::Fmpq r;
+        r.set(nums[i], dens[1]);
+        flint::PadicNumber y(ctx, 15);
+        y.set(r);
+        TEST_CHECK(flint::equal(ys[i], y, 15));
+    }
+}
+
+void test_to_rational()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::Fmpz numBound, denBound;
+    numBound.set(static_cast<flint::unsigned_long_t>(1000000000));
+    denBound.set(static_cast<flint::unsigned_long_t>(1000000));
+
+    std::vector<flint::Fmpq> qs(4);
+    qs[0].set(static_cast<flint::signed_long_t>(-123456789), static_cast<flint::unsigned_long_t>(98765));
+    qs[1].set(static_cast<flint::signed_long_t>(5), static_cast<flint::unsigned_long_t>(49 * 11));
+    qs[2].set(static_cast<flint::signed_long_t>(343 * 2), static_cast<flint::unsigned_long_t>(3));
+    qs[3].set(static_cast<flint::signed_long_t>(0), static_cast<flint::unsigned_long_t>(1));
+
+    std::vector<flint::PadicNumber> xs(qs.size(), flint::PadicNumber(ctx, 40));
+    for(std::size_t i = 0; i < qs.size(); i++)
+    {
+        xs[i].set(qs[i]);
+        auto r = flint::to_rational(xs[i], numBound, denBound);
+        TEST_CHECK(r.has_value() && *r == qs[i]);
+        auto balanced = flint::to_rational(xs[i]);
+        TEST_CHECK(balanced.has_value() && *balanced == qs[i]);
+    }
+
+    auto batch = flint::to_rational(xs, numBound, denBound, 3);
+    for(std::size_t i = 0; i < qs.size(); i++)
+    {
+        TEST_CHECK(batch[i].has_value() && *batch[i] == qs[i]);
+    }
+
+    // 5/11 is not close to a small integer
+    flint::Fmpz one, ten;
+    one.set(static_cast<flint::unsigned_long_t>(1));
+    ten.set(static_cast<flint::unsigned_long_t>(10));
+    flint::Fmpq q;
+    q.set(static_cast<flint::signed_long_t>(5), static_cast<flint::unsigned_long_t>(11));
+    flint::PadicNumber y(ctx, 40);
+    y.set(q);
+    TEST_CHECK(!flint::to_rational(y, ten, one).has_value());
+    TEST_CHECK(!flint::to_rational(xs[1], ten, ten).has_value());
+
+    // p = 2 with an odd exponent: 2^5 = 32, the balanced bound is 3 and 2·3·3 < 32
+    flint::Fmpz two;
+    two.set(static_cast<flint::unsigned_long_t>(2));
+    auto ctx2 = std::make_shared<flint::PadicContext>(two);
+    for(flint::signed_long_t a = -3; a <= 3; a++)
+    {
+        for(flint::unsigned_long_t b = 1; b <= 3; b += 2)
+        {
+            flint::Fmpq r;
+            r.set(a, b);
+            flint::PadicNumber z(ctx2, 5);
+            z.set(r);
+            auto back = flint::to_rational(z);
+            TEST_CHECK(back.has_value() && *back == r);
+        }
+    }
+    flint::PadicNumber w(ctx2, 5);
+    w.set(static_cast<flint::signed_long_t>(16));
+    TEST_CHECK(!flint::to_rational(w).has_value());
+}
+
+void test_expansion()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    std::vector<std::pair<flint::signed_long_t, flint::unsigned_long_t>> fractions{
+        { 1, 13 }, { -1, 13 }, { 123456, 13 }, { -5, 49 * 11 }, { 343 * 1000, 3 }, { 42, 1 }, { -42, 1 }, { 0, 1 }
+    };
+    for(auto [a, b] : fractions)
+    {
+        flint::Fmpq q;
+        q.set(a, b);
+        flint::PadicExpansion e(ctx, q);
+
+        flint::PadicNumber x(ctx, 40);
+        x.set(q);
+        const flint::signed_long_t floor = std::min<flint::signed_long_t>(e.val(), 0);
+        flint::PadicDigits digits(ctx, 40, floor);
+        auto expected = digits(x);
+        for(flint::signed_long_t i = floor; i < 40; i++)
+        {
+            TEST_CHECK(e.digit(i) == expected[i - floor]);
+        }
+    }
+
+    // the period of 1/13 is the order of 7 modulo 13
+    flint::Fmpq q;
+    q.set(static_cast<flint::signed_long_t>(123456), static_cast<flint::unsigned_long_t>(13));
+    flint::PadicExpansion e(ctx, q);
+    TEST_CHECK(e.period().size() == 12);
+    TEST_CHECK(!e.preperiod().empty());
+
+    flint::Fmpz huge, i;
+    huge.set(static_cast<flint::unsigned_long_t>(1000000007));
+    huge = huge * huge * huge;
+    i.set(static_cast<flint::signed_long_t>(e.preperiod().size()));
+    const auto r = fmpz_fdiv_ui(huge.get(), 12);
+    fmpz_add(huge.get(), huge.get(), i.get());
+    TEST_CHECK(e.digit(huge) == e.period()[r]);
+
+    TEST_EXCEPTION(flint::PadicExpansion(ctx, q, 5), std::overflow_error);
+}
+
+void test_order()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(13));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    const auto& factors = ctx->unitGroupFactors();
+    TEST_CHECK(factors.size() == 2);
+    TEST_CHECK(factors[0].first.toString(flint::Base(10)) == "2" && factors[0].second == 2);
+    TEST_CHECK(factors[1].first.toString(flint::Base(10)) == "3" && factors[1].second == 1);
+    TEST_CHECK(ctx->primitiveRoot().toString(flint::Base(10)) == "2");
+    TEST_CHECK(&ctx->unitGroupFactors() == &factors);
+
+    // orders modulo 13 and 13^3 by brute force
+    for(flint::signed_long_t a = 1; a < 60; a++)
+    {
+        if(a % 13 == 0)
+        {
+            continue;
+        }
+        flint::PadicNumber x(ctx, 3);
+        x.set(a);
+        flint::signed_long_t k = 1, y = a % 2197;
+        while(y != 1)
+        {
+            y = (y * a) % 2197;
+            k++;
+        }
+        TEST_CHECK(flint::order(x).toString(flint::Base(10)) == std::to_string(k));
+        TEST_CHECK(flint::is_primitive(x) == (k == 12 * 169));
+    }
+
+    flint::Fmpz two;
+    two.set(static_cast<flint::unsigned_long_t>(2));
+    auto ctx2 = std::make_shared<flint::PadicContext>(two);
+    TEST_CHECK(ctx2->primitiveRoot().toString(flint::Base(10)) == "1");
+    for(flint::signed_long_t a = 1; a < 40; a += 2)
+    {
+        flint::PadicNumber x(ctx2, 6);
+        x.set(a);
+        flint::signed_long_t k = 1, y = a % 64;
+        while(y != 1)
+        {
+            y = (y * a) % 64;
+            k++;
+        }
+        TEST_CHECK(flint::order(x).toString(flint::Base(10)) == std::to_string(k));
+        TEST_CHECK(!flint::is_primitive(x));
+    }
+
+    flint::PadicNumber z(ctx, 3);
+    z.set(static_cast<flint::unsigned_long_t>(26));
+    TEST_EXCEPTION(flint::order(z), std::domain_error);
+}
+
+void test_teichmuller()
+{
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(13));
+
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+    auto tabled = std::make_shared<flint::PadicContext>(p);
+    tabled->precomputeTeichmuller(30);
+    TEST_CHECK(tabled->teichmullerPrec() == 30);
+    TEST_CHECK(ctx->teichmullerPrec() == 0);
+
+    flint::Fmpz twelve;
+    twelve.set(static_cast<flint::unsigned_long_t>(12));
+    for(flint::signed_long_t a = 1; a < 40; a++)
+    {
+        flint::PadicNumber x(ctx, 20), y(tabled, 20);
+        x.set(a * 13 * 13 + (a % 13 == 0 ? 0 : a * 1000003));
+        y.set(a * 13 * 13 + (a % 13 == 0 ? 0 : a * 1000003));
+
+        auto w = flint::teichmuller(x, 20);
+        auto v = flint::teichmuller(y, 20);
+        TEST_CHECK(w.toString(flint::PadicPrintMode::TERSE) == v.toString(flint::PadicPrintMode::TERSE));
+        if(x.val() > 0)
+        {
+            TEST_CHECK(w.toString(flint::PadicPrintMode::TERSE) == "0");
+            continue;
+        }
+        TEST_CHECK(flint::equal(w, x, 1));
+        TEST_CHECK(flint::equal(flint::pow(w, twelve, 20), x / x, 20));
+
+        auto u = flint::principal_unit(y, 20);
+        TEST_CHECK(flint::equal(u, x / x, 1));
+        TEST_CHECK(flint::equal(v * u, y, 20));
+    }
+
+    auto roots = flint::roots_of_unity(tabled, 20);
+    TEST_CHECK(roots.size() == 12);
+    std::unordered_set<flint::PadicNumber> distinct(roots.begin(), roots.end());
+    TEST_CHECK(distinct.size() == 12);
+    for(auto& r : roots)
+    {
+        TEST_CHECK(flint::equal(flint::pow(r, twelve, 20), roots[0], 20));
+        TEST_CHECK(flint::equal(flint::teichmuller(r, 20), r, 20));
+    }
+}
+
+void test_roots()
+{
+    for(flint::unsigned_long_t prime : { 13ul, 7ul, 2ul })
+    {
+        flint::Fmpz p;
+        p.set(prime);
+        auto ctx = std::make_shared<flint::PadicContext>(p);
+
+        for(flint::unsigned_long_t n : { 1ul, 2ul, 3ul, 4ul, 6ul, 12ul, 5ul, 7ul, 13ul, 26ul, 8ul })
+        {
+            flint::Fmpz e;
+            e.set(n);
+            for(flint::signed_long_t b = -9; b < 30; b += 2)
+            {
+                flint::PadicNumber base(ctx, 30);
+                base.set(b * 1000003 + static_cast<flint::signed_long_t>(prime) * 7);
+                if(base.val() != 0)
+                {
+                    continue;
+                }
+                const auto z = flint::pow(base, e, 30) << static_cast<flint::signed_long_t>(n);
+                auto r = flint::nth_root(z, n, 25);
+                TEST_CHECK(r.val() == 1);
+                TEST_CHECK(flint::equal(flint::pow(r, e, 40), z, 25));
+                if(n > 1)
+                {
+                    TEST_EXCEPTION(flint::nth_root(z << 1, n, 25), std::domain_error);
+                }
+            }
+        }
+
+        // squares by brute force in the residue field
+        std::vector<flint::PadicNumber> xs;
+        for(flint::signed_long_t a = 1; a < 80; a++)
+        {
+            flint::PadicNumber x(ctx, 20);
+            x.set(a);
+            xs.push_back(x);
+        }
+        auto roots = flint::sqrt(xs, 20, 3);
+        for(std::size_t i = 0; i < xs.size(); i++)
+        {
+            flint::signed_long_t a = static_cast<flint::signed_long_t>(i) + 1;
+            flint::signed_long_t v = 0;
+            while(a % static_cast<flint::signed_long_t>(prime) == 0)
+            {
+                a /= prime;
+                v++;
+            }
+            const flint::signed_long_t modulus = prime == 2 ? 8 : prime;
+            bool square = false;
+            for(flint::signed_long_t c = 1; c < modulus; c++)
+            {
+                square = square || (c * c - a) % modulus == 0;
+            }
+            square = square && v % 2 == 0;
+            TEST_CHECK(roots[i].has_value() == square);
+            if(square)
+            {
+                TEST_CHECK(flint::equal(*roots[i] * *roots[i], xs[i], 20));
+                if(prime == 2)
+                {
+                    flint::PadicNumber one(ctx);
+                    one.set(static_cast<flint::unsigned_long_t>(1));
+                    TEST_CHECK(flint::equal(flint::principal_unit(*roots[i], 20), one, 2));
+                }
+            }
+        }
+    }
+
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(13));
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+    flint::PadicNumber x(ctx, 20);
+    x.set(static_cast<flint::unsigned_long_t>(2));
+    TEST_EXCEPTION(flint::sqrt(x), std::domain_error);
+    x.set(static_cast<flint::unsigned_long_t>(14));
+    TEST_EXCEPTION(flint::nth_root(x, 13), std::domain_error);
+    x.set(static_cast<flint::unsigned_long_t>(1 + 169));
+    TEST_CHECK(flint::equal(flint::pow(flint::nth_root(x, 13, 20), flint::Fmpz(p), 20), x, 20));
+}
+
+void test_dlog()
+{
+    // exhaustively against brute force in (Z/49)^* and (Z/32)^*
+    for(auto [prime, N] : { std::pair<flint::unsigned_long_t, flint::signed_long_t>{ 7, 2 }, { 2, 5 }, { 3, 3 } })
+    {
+        flint::Fmpz p;
+        p.set(prime);
+        auto ctx = std::make_shared<flint::PadicContext>(p);
+        flint::signed_long_t modulus = 1;
+        for(flint::signed_long_t i = 0; i < N; i++)
+        {
+            modulus *= prime;
+        }
+
+        for(flint::signed_long_t g = 1; g < modulus; g++)
+        {
+            if(g % static_cast<flint::signed_long_t>(prime) == 0)
+            {
+                continue;
+            }
+            flint::PadicNumber base(ctx, N);
+            base.set(g);
+            flint::PadicDlog dlog(base);
+
+            std::vector<flint::signed_long_t> logs(modulus, -1);
+            flint::signed_long_t order = 0;
+            for(flint::signed_long_t k = 0, y = 1; logs[y] < 0; k++, y = (y * g) % modulus)
+            {
+                logs[y] = k;
+                order++;
+            }
+            TEST_CHECK(dlog.order().toString(flint::Base(10)) == std::to_string(order));
+
+            std::vector<flint::PadicNumber> hs;
+            for(flint::signed_long_t h = 1; h < modulus; h++)
+            {
+                flint::PadicNumber x(ctx, N);
+                x.set(h);
+                hs.push_back(x);
+            }
+            auto ks = dlog(hs, 2);
+            for(flint::signed_long_t h = 1; h < modulus; h++)
+            {
+                const auto& k = ks[h - 1];
+                if(h % static_cast<flint::signed_long_t>(prime) == 0)
+                {
+                    TEST_CHECK(!k.has_value());
+                    continue;
+                }
+                TEST_CHECK(k.has_value() == (logs[h] >= 0));
+                if(k)
+                {
+                    TEST_CHECK(k->toString(flint::Base(10)) == std::to_string(logs[h]));
+                }
+            }
+        }
+    }
+
+    // large exponents at full precision
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(1000003));
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+    flint::PadicNumber g(ctx, 15);
+    g.set(static_cast<flint::unsigned_long_t>(2));
+    flint::PadicDlog dlog(g);
+    flint::Fmpz k;
+    k.set(static_cast<flint::unsigned_long_t>(123456789123456789ull));
+    k = k * k;
+    auto h = flint::pow(g, k, 15);
+    auto r = flint::dlog(g, h);
+    TEST_CHECK(r.has_value());
+    TEST_CHECK(flint::equal(flint::pow(g, *r, 15), h, 15));
+    fmpz_sub(k.get(), k.get(), r->get());
+    TEST_CHECK(fmpz_divisible(k.get(), dlog.order().get()));
+}
+
+void test_hilbert()
+{
+    const std::vector<flint::unsigned_long_t> primes{ 2, 3, 5, 7, 11, 13, 17, 19, 23, 29 };
+    std::vector<std::shared_ptr<flint::PadicContext>> ctxs;
+    for(auto q : primes)
+    {
+        flint::Fmpz p;
+        p.set(q);
+        ctxs.push_back(std::make_shared<flint::PadicContext>(p));
+    }
+
+    // product formula: (a, b)_∞ · ∏_p (a, b)_p = 1
+    for(flint::signed_long_t a = -30; a <= 30; a++)
+    {
+        for(flint::signed_long_t b = -30; b <= 30; b++)
+        {
+            if(a == 0 || b == 0)
+            {
+                continue;
+            }
+            int product = a < 0 && b < 0 ? -1 : 1;
+            for(std::size_t i = 0; i < primes.size(); i++)
+            {
+                flint::PadicNumber x(ctxs[i], 10), y(ctxs[i], 10);
+                x.set(a);
+                y.set(b);
+                product *= flint::hilbert_symbol(x, y);
+            }
+            TEST_CHECK(product == 1);
+        }
+    }
+
+    auto form = [](std::shared_ptr<flint::PadicContext> ctx, std::vector<flint::signed_long_t> as)
+    {
+        std::vector<flint::PadicNumber> diagonal;
+        for(auto a : as)
+        {
+            flint::PadicNumber x(ctx, 10);
+            x.set(a);
+            diagonal.push_back(x);
+        }
+        return diagonal;
+    };
+    auto& q2 = ctxs[0];
+    auto& q3 = ctxs[1];
+    auto& q5 = ctxs[2];
+
+    TEST_CHECK(flint::quadratic_invariants(form(q2, { 1, 1 })) == flint::quadratic_invariants(form(q2, { 2, 2 })));
+    TEST_CHECK(flint::quadratic_invariants(form(q3, { 1, 1 })) == flint::quadratic_invariants(form(q3, { 5, 5 })));
+    TEST_CHECK(!(flint::quadratic_invariants(form(q3, { 1, 1 })) == flint::quadratic_invariants(form(q3, { 1, 2 }))));
+    TEST_CHECK(flint::quadratic_invariants(form(q3, { 1, -1 })).isotropic);
+    TEST_CHECK(flint::quadratic_invariants(form(q5, { 1, 1 })).isotropic);
+    TEST_CHECK(!flint::quadratic_invariants(form(q3, { 1, 1 })).isotropic);
+    TEST_CHECK(!flint::quadratic_invariants(form(q2, { 1, 1, 1 })).isotropic);
+    TEST_CHECK(flint::quadratic_invariants(form(q3, { 1, 1, 1 })).isotropic);
+    TEST_CHECK(!flint::quadratic_invariants(form(q2, { 1, 1, 1, 1 })).isotropic);
+    TEST_CHECK(flint::quadratic_invariants(form(q3, { 1, 1, 1, 1 })).isotropic);
+    TEST_CHECK(flint::quadratic_invariants(form(q2, { 1, 1, 1, 1, 1 })).isotropic);
+
+    // 3 at precision 1 is stored as the unit 1, too short to tell its class modulo 8
+    flint::PadicNumber short3(q2, 1), three(q2, 10);
+    short3.set(static_cast<flint::signed_long_t>(3));
+    three.set(static_cast<flint::signed_long_t>(3));
+    TEST_CHECK(flint::hilbert_symbol(three, three) == -1);
+    TEST_EXCEPTION(flint::hilbert_symbol(short3, short3), std::domain_error);
+    TEST_EXCEPTION(flint::quadratic_invariants(std::vector<flint::PadicNumber>{ short3, three }), std::domain_error);
+
+    std::vector<std::vector<flint::PadicNumber>> forms;
+    for(flint::signed_long_t a = 1; a < 40; a++)
+    {
+        forms.push_back(form(q2, { a, -a * 3, a + 7, 12 }));
+    }
+    auto batch = flint::quadratic_invariants(forms, 3);
+    for(std::size_t i = 0; i < forms.size(); i++)
+    {
+        TEST_CHECK(batch[i] == flint::quadratic_invariants(forms[i]));
+        TEST_CHECK(batch[i].dim == 4);
+    }
+}
+
+void test_multi_prime()
+{
+    std::vector<std::shared_ptr<flint::PadicContext>> ctxs;
+    for(flint::unsigned_long_t q = 2; q <= 47; q++)
+    {
+        flint::Fmpz p;
+        p.set(q);
+        if(p.isPrime())
+        {
+            ctxs.push_back(std::make_shared<flint::PadicContext>(p));
+        }
+    }
+    flint::MultiPrimeConverter converter(ctxs, 20);
+    TEST_CHECK(converter.size() == 15);
+
+    std::vector<flint::Fmpz> xs(4);
+    fmpz_ui_pow_ui(xs[0].get(), 10, 60);
+    fmpz_add_ui(xs[0].get(), xs[0].get(), 7);
+    fmpz_ui_pow_ui(xs[1].get(), 3, 15);
+    fmpz_mul_ui(xs[1].get(), xs[1].get(), 47 * 47);
+    fmpz_neg(xs[2].get(), xs[0].get());
+    fmpz_zero(xs[3].get());
+
+    flint::Fmpz one;
+    one.set(static_cast<flint::unsigned_long_t>(1));
+    auto images = converter.images(xs);
+    for(std::size_t j = 0; j < xs.size(); j++)
+    {
+        for(std::size_t i = 0; i < ctxs.size(); i++)
+        {
+            flint::Fmpq q;
+            q.set(xs[j], one);
+            flint::PadicNumber expected(ctxs[i], 20);
+            expected.set(q);
+            TEST_CHECK(images[j][i] == expected);
+        }
+        TEST_CHECK(converter.reconstruct(images[j], true) == xs[j]);
+    }
+    TEST_CHECK(images[1][1].val() == 15);
+    TEST_CHECK(images[1][14].val() == 2);
+
+    flint::Fmpz y;
+    fmpz_add(y.get(), xs[2].get(), converter.modulus().get());
+    TEST_CHECK(converter.reconstruct(images[2]) == y);
+
+    TEST_EXCEPTION(flint::MultiPrimeConverter({ ctxs[0], ctxs[0] }, 5), std::invalid_argument);
+}
+
+void test_multi_prime_runner()
+{
+    flint::MultiPrimeRunner runner(2, 47, 4);
+    TEST_CHECK(runner.size() == 15);
+    TEST_CHECK(flint::MultiPrimeRunner(48, 52).size() == 0);
+    TEST_CHECK(flint::MultiPrimeRunner(47, 47).size() == 1);
+
+    // x = 2 · 3 · ... · 47 has valuation 1 at every prime and x + 1 has valuation 0
+    flint::unsigned_long_t x_int = 614889782588491410ull;
+    auto vals = runner.run([x_int](const std::shared_ptr<flint::PadicContext>& ctx)
+    {
+        flint::PadicNumber x(ctx), y(ctx);
+        x.set(x_int);
+        y.set(static_cast<flint::unsigned_long_t>(1));
+        return std::make_pair(x.val(), (x + y).val());
+    }, 3);
+    TEST_CHECK(vals.size() == 15);
+    for(const auto& [x_val, z_val] : vals)
+    {
+        TEST_CHECK(x_val == 1);
+        TEST_CHECK(z_val == 0);
+    }
+
+    auto primes = runner.run([](const std::shared_ptr<flint::PadicContext>& ctx)
+    {
+        return fmpz_get_ui(ctx->get()->p);
+    });
+    for(std::size_t i = 1; i < primes.size(); i++)
+    {
+        TEST_CHECK(primes[i - 1] < primes[i]);
+    }
+
+    flint::MultiPrimeRunner reused(runner.contexts());
+    TEST_CHECK(reused.contexts()[3] == runner.contexts()[3]);
+    TEST_EXCEPTION(reused.run([](const std::shared_ptr<flint::PadicContext>& ctx)
+    {
+        if(fmpz_equal_ui(ctx->get()->p, 13))
+        {
+            throw std::domain_error("13");
+        }
+        return 0;
+    }, 4), std::domain_error);
+}
+
+void test_crt_number()
+{
+    // n = 2^5 · 3^3 · 7^2 · 101
+    flint::Fmpz n;
+    n.set(static_cast<flint::unsigned_long_t>(32 * 27 * 49 * 101));
+    auto modulus = std::make_shared<const flint::MultiPrimeConverter>(n);
+    TEST_CHECK(modulus->size() == 4);
+    TEST_CHECK(modulus->modulus() == n);
+    TEST_CHECK(modulus->prec(0) == 5);
+    TEST_CHECK(modulus->prec(3) == 1);
+
+    auto reduce = [&n](flint::Fmpz x)
+    {
+        fmpz_mod(x.get(), x.get(), n.get());
+        return x;
+    };
+
+    for(flint::signed_long_t a = -5000; a < 5000; a += 337)
+    {
+        const flint::signed_long_t b = 7 * a + 1234567;
+        flint::Fmpz fa, fb;
+        fa.set(a);
+        fb.set(b);
+        flint::CrtNumber x(modulus), y(modulus);
+        x.set(fa);
+        y.set(b);
+
+        flint::Fmpz expected;
+        fmpz_add(expected.get(), fa.get(), fb.get());
+        TEST_CHECK((x + y).get() == reduce(expected));
+        fmpz_sub(expected.get(), fa.get(), fb.get());
+        TEST_CHECK((x - y).get() == reduce(expected));
+        fmpz_mul(expected.get(), fa.get(), fb.get());
+        TEST_CHECK((x * y).get() == reduce(expected));
+        TEST_CHECK(x.get(true) == fa);
+
+        flint::Fmpz e;
+        e.set(static_cast<flint::unsigned_long_t>(1000003));
+        fmpz_powm(expected.get(), reduce(fb).get(), e.get(), n.get());
+        TEST_CHECK(flint::pow(y, e, 3).get() == expected);
+
+        if(fmpz_invmod(expected.get(), fb.get(), n.get()))
+        {
+            TEST_CHECK(y.isUnit());
+            TEST_CHECK(flint::inv(y).get() == expected);
+            flint::Fmpz minus_e;
+            fmpz_neg(minus_e.get(), e.get());
+            flint::CrtNumber one(modulus);
+            one.set(static_cast<flint::signed_long_t>(1));
+            TEST_CHECK(flint::pow(y, minus_e) * flint::pow(y, e) == one);
+            TEST_CHECK(x * y * flint::inv(y) == x);
+        }
+        else
+        {
+            TEST_CHECK(!y.isUnit());
+            TEST_EXCEPTION(flint::inv(y), std::domain_error);
+        }
+    }
+
+    flint::CrtNumber z(std::make_shared<const flint::MultiPrimeConverter>(n));
+    TEST_EXCEPTION(z + flint::CrtNumber(modulus), std::invalid_argument);
+    TEST_EXCEPTION(flint::MultiPrimeConverter(flint::Fmpz()), std::invalid_argument);
+}
+
+void test_valuations()
+{
+    flint::Fmpz p, x;
+    p.set(static_cast<flint::unsigned_long_t>(3));
+    fmpz_ui_pow_ui(x.get(), 3, 1000);
+    fmpz_mul_ui(x.get(), x.get(), 5);
+    TEST_CHECK(x.valuation(p) == 1000);
+    fmpz_neg(x.get(), x.get());
+    TEST_CHECK(x.valuation(p) == 1000);
+    TEST_EXCEPTION(flint::Fmpz().valuation(p), std::domain_error);
+    TEST_EXCEPTION(x.valuation(flint::Fmpz()), std::invalid_argument);
+
+    auto naive = [](flint::unsigned_long_t u, flint::unsigned_long_t q)
+    {
+        flint::signed_long_t v = 0;
+        for(; u % q == 0; u /= q)
+        {
+            v++;
+        }
+        return v;
+    };
+
+    std::vector<flint::unsigned_long_t> words;
+    for(flint::unsigned_long_t u = 0; u < 5000; u++)
+    {
+        words.push_back(u * 7919);
+    }
+    words.push_back(~0ull);
+    words.push_back(1ull << 63);
+    words.push_back(12157665459056928801ull); // 3^40
+
+    std::vector<flint::Fmpz> values(words.size() + 1);
+    for(std::size_t i = 0; i < words.size(); i++)
+    {
+        values[i].set(words[i]);
+        if(i % 2)
+        {
+            fmpz_neg(values[i].get(), values[i].get());
+        }
+    }
+    fmpz_set(values.back().get(), x.get());
+
+    for(flint::unsigned_long_t q : { 2ull, 3ull, 5ull, 7919ull, 1000003ull })
+    {
+        auto vs = flint::valuations(words, q, 4);
+        auto ws = flint::valuations(values, q, 3);
+        for(std::size_t i = 0; i < words.size(); i++)
+        {
+            TEST_CHECK(vs[i] == ws[i]);
+            if(words[i] == 0)
+            {
+                TEST_CHECK(!vs[i]);
+            }
+            else
+            {
+                TEST_CHECK(vs[i] == naive(words[i], q));
+            }
+        }
+        flint::Fmpz fq;
+        fq.set(q);
+        TEST_CHECK(ws.back() == x.valuation(fq));
+    }
+    TEST_CHECK(flint::valuations(words, 3).back() == 40);
+    TEST_EXCEPTION(flint::valuations(words, 4), std::invalid_argument);
+
+    // Legendre and Kummer against the products
+    for(flint::unsigned_long_t q : { 2ull, 3ull, 7ull })
+    {
+        flint::Fmpz fq, f;
+        fq.set(q);
+        for(flint::unsigned_long_t n = 1; n < 60; n++)
+        {
+            fmpz_fac_ui(f.get(), n);
+            TEST_CHECK(static_cast<flint::signed_long_t>(flint::factorial_valuation(n, q)) == f.valuation(fq));
+            for(flint::unsigned_long_t k = 0; k <= n; k++)
+            {
+                fmpz_bin_uiui(f.get(), n, k);
+                TEST_CHECK(static_cast<flint::signed_long_t>(flint::binomial_valuation(n, k, q)) == f.valuation(fq));
+            }
+        }
+    }
+    TEST_CHECK(flint::factorial_valuation(1000000000000ull, 7) == 166666666660ull);
+    TEST_EXCEPTION(flint::binomial_valuation(3, 4, 2), std::domain_error);
+}
+
+void test_smooth()
+{
+    flint::SmoothFactoriser factoriser(100, 2);
+    TEST_CHECK(factoriser.primeCount() == 25);
+
+    std::vector<flint::Fmpz> xs(3000);
+    for(std::size_t i = 0; i < xs.size(); i++)
+    {
+        xs[i].set(static_cast<flint::signed_long_t>(i * i * 37 + i) * (i % 3 == 0 ? -1 : 1));
+    }
+    // 2^300 · 97^40 · 101 · 1000003
+    flint::Fmpz big, f;
+    fmpz_ui_pow_ui(big.get(), 2, 300);
+    fmpz_ui_pow_ui(f.get(), 97, 40);
+    fmpz_mul(big.get(), big.get(), f.get());
+    fmpz_mul_ui(big.get(), big.get(), 101 * 1000003ull);
+    xs.push_back(big);
+
+    auto result = factoriser(xs, 4);
+    TEST_CHECK(!result[0]);
+    for(std::size_t i = 1; i < xs.size(); i++)
+    {
+        const auto& factors = *result[i];
+        flint::Fmpz product;
+        fmpz_set(product.get(), factors.cofactor.get());
+        for(std::size_t j = 0; j < factors.valuations.size(); j++)
+        {
+            auto [p, v] = factors.valuations[j];
+            TEST_CHECK(p <= 100 && n_is_prime(p) && v > 0);
+            TEST_CHECK(j == 0 || factors.valuations[j - 1].first < p);
+            fmpz_ui_pow_ui(f.get(), p, v);
+            fmpz_mul(product.get(), product.get(), f.get());
+        }
+        fmpz_abs(f.get(), xs[i].get());
+        TEST_CHECK(product == f);
+        for(flint::unsigned_long_t p = 2; p <= 100; p = n_nextprime(p, 1))
+        {
+            TEST_CHECK(fmpz_fdiv_ui(factors.cofactor.get(), p) != 0);
+        }
+    }
+
+    const auto& last = *result.back();
+    TEST_CHECK(last.valuations.size() == 2);
+    TEST_CHECK(last.valuations[0].first == 2 && last.valuations[0].second == 300);
+    TEST_CHECK(last.valuations[1].first == 97 && last.valuations[1].second == 40);
+    TEST_CHECK(!last.isSmooth());
+    TEST_CHECK(result[1]->isSmooth()); // 38
+
+    TEST_EXCEPTION(flint::SmoothFactoriser(1), std::invalid_argument);
+
+    // B = 10^5 over 4000 inputs with known factorisations
+    flint::SmoothFactoriser large(100000);
+    TEST_CHECK(large.primeCount() == 9592);
+    std::vector<flint::Fmpz> ys(4000);
+    std::vector<std::map<flint::unsigned_long_t, flint::signed_long_t>> expected(ys.size());
+    std::vector<flint::unsigned_long_t> rough(ys.size());
+    const std::array<flint::unsigned_long_t, 3> roughs{ 1, 100003, 1000003 };
+    std::uint64_t state = 12345;
+    auto next = [&state]()
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return state >> 33;
+    };
+    for(std::size_t i = 0; i < ys.size(); i++)
+    {
+        fmpz_one(ys[i].get());
+        for(std::uint64_t j = next() % 5; j > 0; j--)
+        {
+            const flint::unsigned_long_t q = n_nextprime(next() % 99990, 1);
+            const flint::unsigned_long_t e = 1 + next() % 3;
+            expected[i][q] += e;
+            fmpz_ui_pow_ui(f.get(), q, e);
+            fmpz_mul(ys[i].get(), ys[i].get(), f.get());
+        }
+        rough[i] = roughs[i % 3];
+        fmpz_mul_ui(ys[i].get(), ys[i].get(), rough[i]);
+    }
+
+    auto factored = large(ys, 4);
+    for(std::size_t i = 0; i < ys.size(); i++)
+    {
+        const auto& factors = *factored[i];
+        TEST_CHECK(factors.valuations.size() == expected[i].size());
+        TEST_CHECK(std::equal(factors.valuations.begin(), factors.valuations.end(), expected[i].begin(), expected[i].end(),
+            [](const auto& a, const auto& b) { return a.first == b.first && a.second == b.second; }));
+        TEST_CHECK(fmpz_equal_ui(factors.cofactor.get(), rough[i]));
+        TEST_CHECK(factors.isSmooth() == (rough[i] == 1));
+    }
+}
+
+void test_binomial_mod()
+{
+    for(flint::unsigned_long_t q : { 2ull, 3ull, 7ull })
+    {
+        flint::Fmpz p;
+        p.set(q);
+        auto ctx = std::make_shared<flint::PadicContext>(p);
+        flint::PadicFactorial table(ctx, 12);
+        for(flint::unsigned_long_t n = 0; n < 80; n++)
+        {
+            flint::Fmpz f, one;
+            one.set(static_cast<flint::unsigned_long_t>(1));
+            flint::Fmpq r;
+            flint::PadicNumber expected(ctx, 12);
+
+            fmpz_fac_ui(f.get(), n);
+            r.set(f, one);
+            expected.set(r);
+            TEST_CHECK(table.factorial(n) == expected);
+
+            for(flint::unsigned_long_t k = 0; k <= n + 1; k++)
+            {
+                fmpz_bin_uiui(f.get(), n, k);
+                r.set(k > n ? flint::Fmpz() : f, one);
+                expected.set(r);
+                TEST_CHECK(table.binomial(n, k) == expected);
+            }
+        }
+    }
+
+    flint::Fmpz p;
+    p.set(static_cast<flint::unsigned_long_t>(7));
+    auto ctx = std::make_shared<flint::PadicContext>(p);
+
+    flint::Fmpz f, one;
+    one.set(static_cast<flint::unsigned_long_t>(1));
+    fmpz_fac_ui(f.get(), 100000);
+    flint::Fmpq r;
+    r.set(f, one);
+    flint::PadicNumber expected(ctx, 20);
+    expected.set(r);
+    TEST_CHECK(flint::factorial_mod(100000, ctx) == expected);
+
+    // n around 10^12 modulo 7^20: symmetry, Pascal's rule and Lucas' theorem modulo 7
+    const flint::unsigned_long_t n = 1000000000000ull;
+    std::vector<std::pair<flint::unsigned_long_t, flint::unsigned_long_t>> nks;
+    for(flint::unsigned_long_t k : { 1ull, 2ull, 7ull, 1234567ull, 98765432101ull, 500000000000ull })
+    {
+        nks.emplace_back(n, k);
+        nks.emplace_back(n, n - k);
+        nks.emplace_back(n - 1, k - 1);
+        nks.emplace_back(n - 1, k);
+    }
+    auto bs = flint::binomial_mod(nks, ctx, 20, 4);
+    for(std::size_t i = 0; i < bs.size(); i += 4)
+    {
+        TEST_CHECK(bs[i] == bs[i + 1]);
+        TEST_CHECK(bs[i] == bs[i + 2] + bs[i + 3]);
+        TEST_CHECK(bs[i] == flint::binomial_mod(nks[i].first, nks[i].second, ctx));
+    }
+    flint::PadicNumber n_mod(ctx, 20);
+    n_mod.set(n);
+    TEST_CHECK(bs[0] == n_mod);
+
+    auto lucas = [](flint::unsigned_long_t a, flint::unsigned_long_t b)
+    {
+        flint::unsigned_long_t y = 1;
+        for(; a > 0 || b > 0; a /= 7, b /= 7)
+        {
+            flint::Fmpz c;
+            fmpz_bin_uiui(c.get(), a % 7, b % 7);
+            y = y * fmpz_fdiv_ui(c.get(), 7) % 7;
+        }
+        return y;
+    };
+    flint::PadicFactorial mod7(ctx, 1);
+    for(flint::unsigned_long_t k : { 3ull, 1234567ull, 98765432101ull })
+    {
+        flint::PadicNumber expected7(ctx, 1);
+        expected7.set(lucas(n, k));
+        TEST_CHECK(mod7.binomial(n, k) == expected7);
+    }
+}
+
 TEST_LIST = {
    { "test_case_1", test_case_1 },
    { "test_case_2", test_case_2 },
@@ -427,5 +1937,30 @@ TEST_LIST = {
    { "test_sub", test_sub },
    { "test_mul", test_mul },
    { "test_val", test_val },
+   { "test_pow", test_pow },
+   { "test_shift", test_shift },
+   { "test_scalar", test_scalar },
+   { "test_dot", test_dot },
+   { "test_accumulator", test_accumulator },
+   { "test_invert_batch", test_invert_batch },
+   { "test_hash", test_hash },
+   { "test_ball_index", test_ball_index },
+   { "test_ultrametric_tree", test_ultrametric_tree },
+   { "test_radix_sort", test_radix_sort },
+   { "test_random", test_random },
+   { "test_fmpq", test_fmpq },
+   { "test_to_rational", test_to_rational },
+   { "test_expansion", test_expansion },
+   { "test_order", test_order },
+   { "test_teichmuller", test_teichmuller },
+   { "test_roots", test_roots },
+   { "test_dlog", test_dlog },
+   { "test_hilbert", test_hilbert },
+   { "test_multi_prime", test_multi_prime },
+   { "test_multi_prime_runner", test_multi_prime_runner },
+   { "test_crt_number", test_crt_number },
+   { "test_valuations", test_valuations },
+   { "test_smooth", test_smooth },
+   { "test_binomial_mod", test_binomial_mod },
    { NULL, NULL }     /* zeroed record marking the end of the list */
 };
\ No newline at end of file
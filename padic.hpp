@@ -4,6 +4,9 @@
 #include <gmp.h>
 #include <flint/flint.h>
 #include <flint/fmpz.h>
+#include <flint/fmpz_factor.h>
+#include <flint/fmpq.h>
+#include <flint/ulong_extras.h>
 #include <flint/fmpz_mod_poly.h>
 #include <flint/aprcl.h>
 #include <flint/padic.h>
@@ -12,6 +15,22 @@
 #include <memory>
 #include <string>
 #include <stdexcept>
+#include <concepts>
+#include <type_traits>
+#include <span>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <exception>
+#include <bit>
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <atomic>
 
 #include <iostream>
 
@@ -70,6 +89,29 @@ namespace flint
             fmpz_init2(_val, limbs);
         }
 
+        Fmpz(const Fmpz& other)
+        {
+            fmpz_init_set(_val, other._val);
+        }
+
+        Fmpz(Fmpz&& other) noexcept
+        {
+            fmpz_init(_val);
+            fmpz_swap(_val, other._val);
+        }
+
+        Fmpz& operator = (const Fmpz& other)
+        {
+            fmpz_set(_val, other._val);
+            return *this;
+        }
+
+        Fmpz& operator = (Fmpz&& other) noexcept
+        {
+            fmpz_swap(_val, other._val);
+            return *this;
+        }
+
         //! @brief Set the value of the fmpz_t to an unsigned long.
         //! @param val The value to set the fmpz_t to.
         void set(const unsigned_long_t val) 
@@ -89,6 +131,11 @@ namespace flint
             return _val;
         }
 
+        fmpz_t& get()
+        {
+            return _val;
+        }
+
         //! @brief Print the value of the fmpz_t to a string.
         //! @param b The base to print the value in.
         std::string toString(const Base b) const
@@ -104,8 +151,34 @@ namespace flint
             return aprcl_is_prime(_val);
         }
 
+        //! @brief The multiplicity of p in the value.
+        //! @details fmpz_remove divides by p, p^2, p^4, ... and back down, so huge powers of p
+        //!          cost O(log v) divisions instead of v.
+        //! @param p At least 2.
+        signed_long_t valuation(const Fmpz& p) const
+        {
+            if(fmpz_cmp_ui(p._val, 2) < 0)
+            {
+                throw std::invalid_argument("The base of a valuation must be at least 2.");
+            }
+            if(fmpz_is_zero(_val))
+            {
+                throw std::domain_error("The valuation of zero is infinite.");
+            }
+            fmpz_t rest;
+            fmpz_init(rest);
+            const signed_long_t v = fmpz_remove(rest, _val, p._val);
+            fmpz_clear(rest);
+            return v;
+        }
+
         friend Fmpz operator * (const Fmpz& lhs, const Fmpz& rhs); 
 
+        friend bool operator == (const Fmpz& lhs, const Fmpz& rhs)
+        {
+            return fmpz_equal(lhs._val, rhs._val);
+        }
+
         ~Fmpz() 
         {
             fmpz_clear(_val);
@@ -125,12 +198,206 @@ namespace flint
         return y;
     }
 
+    std::size_t _hashMix(std::size_t h, std::uint64_t k)
+    {
+        k *= 0x9E3779B97F4A7C15ull;
+        k ^= k >> 32;
+        h ^= k;
+        h *= 0xBF58476D1CE4E5B9ull;
+        return h ^ (h >> 29);
+    }
+
+    //! @brief Hash of an fmpz_t, small values directly and large ones limb by limb.
+    std::size_t _hash(const fmpz* f, std::size_t seed = 0)
+    {
+        if(!COEFF_IS_MPZ(*f))
+        {
+            return _hashMix(seed, static_cast<std::uint64_t>(*f));
+        }
+        const __mpz_struct* z = COEFF_TO_PTR(*f);
+        const mp_size_t n = z->_mp_size < 0 ? -z->_mp_size : z->_mp_size;
+        std::size_t h = _hashMix(seed, static_cast<std::uint64_t>(z->_mp_size));
+        for(mp_size_t i = 0; i < n; i++)
+        {
+            h = _hashMix(h, z->_mp_d[i]);
+        }
+        return h;
+    }
+
+    std::size_t hash(const Fmpz& x)
+    {
+        return _hash(x.get());
+    }
+
+
+    class Fmpq 
+    {
+    private:
+        fmpq_t _val;
+
+    public:
+        //! @brief Default constructor.
+        //! @details Initializes the fmpq_t value to zero.
+        Fmpq() 
+        {
+            fmpq_init(_val);
+        }
+
+        Fmpq(const Fmpq& other)
+        {
+            fmpq_init(_val);
+            fmpq_set(_val, other._val);
+        }
+
+        Fmpq(Fmpq&& other) noexcept
+        {
+            fmpq_init(_val);
+            fmpq_swap(_val, other._val);
+        }
+
+        Fmpq& operator = (const Fmpq& other)
+        {
+            fmpq_set(_val, other._val);
+            return *this;
+        }
+
+        Fmpq& operator = (Fmpq&& other) noexcept
+        {
+            fmpq_swap(_val, other._val);
+            return *this;
+        }
+
+        //! @brief Set the value of the fmpq_t to num/den in lowest terms.
+        void set(const signed_long_t num, const unsigned_long_t den) 
+        {
+            if(den == 0)
+            {
+                throw std::domain_error("The denominator is zero.");
+            }
+            fmpq_set_si(_val, num, den);
+        }
+
+        //! @brief Set the value of the fmpq_t to num/den in lowest terms.
+        void set(const Fmpz& num, const Fmpz& den) 
+        {
+            if(fmpz_is_zero(den.get()))
+            {
+                throw std::domain_error("The denominator is zero.");
+            }
+            fmpq_set_fmpz_frac(_val, num.get(), den.get());
+        }
+
+        const fmpq_t& get() const
+        {
+            return _val;
+        }
+
+        fmpq_t& get()
+        {
+            return _val;
+        }
+
+        Fmpz numerator() const
+        {
+            Fmpz n;
+            fmpz_set(n.get(), fmpq_numref(_val));
+            return n;
+        }
+
+        //! @brief The denominator, always positive.
+        Fmpz denominator() const
+        {
+            Fmpz d;
+            fmpz_set(d.get(), fmpq_denref(_val));
+            return d;
+        }
+
+        //! @brief Print the value of the fmpq_t to a string.
+        //! @param b The base to print the value in.
+        std::string toString(const Base b) const
+        {
+            char* str = fmpq_get_str(nullptr, static_cast<int>(b), _val);
+            std::string result(str);
+            flint_free(str);
+            return result;
+        }
+
+        friend bool operator == (const Fmpq& lhs, const Fmpq& rhs)
+        {
+            return fmpq_equal(lhs._val, rhs._val);
+        }
+
+        ~Fmpq() 
+        {
+            fmpq_clear(_val);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const Fmpq& x)
+        {
+            os << x.toString(Base(10));
+            return os;
+        }
+    };
 
     class PadicContext 
     {
     private:
         padic_ctx_t _ctx;
 
+        // factorisation of p - 1 and the smallest primitive root, computed on first use
+        mutable std::once_flag _unitGroupOnce;
+        mutable std::vector<std::pair<Fmpz, unsigned_long_t>> _unitGroupFactors;
+        mutable Fmpz _primitiveRoot;
+
+        // Teichmüller representatives of 0, ..., p - 1 modulo p^_teichmullerPrec, empty until precomputed
+        mutable std::shared_mutex _teichmullerMutex;
+        std::vector<Fmpz> _teichmuller;
+        signed_long_t _teichmullerPrec = 0;
+
+        void _initUnitGroup() const
+        {
+            std::call_once(_unitGroupOnce, [this]()
+            {
+                Fmpz n;
+                fmpz_sub_ui(n.get(), _ctx->p, 1);
+
+                fmpz_factor_t fac;
+                fmpz_factor_init(fac);
+                fmpz_factor(fac, n.get());
+                for(signed_long_t i = 0; i < fac->num; i++)
+                {
+                    Fmpz q;
+                    fmpz_set(q.get(), fac->p + i);
+                    _unitGroupFactors.emplace_back(std::move(q), fac->exp[i]);
+                }
+                fmpz_factor_clear(fac);
+
+                // g is a primitive root iff g^((p - 1)/q) != 1 for every prime q | p - 1
+                fmpz_t e, r;
+                fmpz_init(e);
+                fmpz_init(r);
+                fmpz_set_ui(_primitiveRoot.get(), 1);
+                bool found = fmpz_is_one(n.get());
+                while(!found)
+                {
+                    fmpz_add_ui(_primitiveRoot.get(), _primitiveRoot.get(), 1);
+                    found = true;
+                    for(const auto& [q, k] : _unitGroupFactors)
+                    {
+                        fmpz_divexact(e, n.get(), q.get());
+                        fmpz_powm(r, _primitiveRoot.get(), e, _ctx->p);
+                        if(fmpz_is_one(r))
+                        {
+                            found = false;
+                            break;
+                        }
+                    }
+                }
+                fmpz_clear(e);
+                fmpz_clear(r);
+            });
+        }
+
     public:
 
         //! @param p The prime number.
@@ -161,8 +428,141 @@ namespace flint
         {
             return _ctx;
         }
+
+        //! @brief The prime factorisation of p - 1 as (prime, exponent) pairs, cached after the first call.
+        const std::vector<std::pair<Fmpz, unsigned_long_t>>& unitGroupFactors() const
+        {
+            _initUnitGroup();
+            return _unitGroupFactors;
+        }
+
+        //! @brief The smallest primitive root modulo p, cached after the first call.
+        const Fmpz& primitiveRoot() const
+        {
+            _initUnitGroup();
+            return _primitiveRoot;
+        }
+
+        //! @brief Precompute the Teichmüller representatives ω(a) of all residues a mod p modulo p^prec.
+        //! @details ω(g) of the primitive root g is lifted once and the table is filled with its
+        //!          powers, p - 2 multiplications in total. Meant for moderate p, p must fit into a word.
+        void precomputeTeichmuller(signed_long_t prec = PADIC_DEFAULT_PREC)
+        {
+            if(!fmpz_abs_fits_ui(_ctx->p))
+            {
+                throw std::invalid_argument("The prime must fit into a word.");
+            }
+            const unsigned_long_t p = fmpz_get_ui(_ctx->p);
+            std::vector<Fmpz> table(p);
+
+            padic_t g, w;
+            padic_init2(g, prec);
+            padic_init2(w, prec);
+            padic_set_fmpz(g, primitiveRoot().get(), _ctx);
+            padic_teichmuller(w, g, _ctx);
+
+            Fmpz pN, power;
+            fmpz_pow_ui(pN.get(), _ctx->p, prec);
+            fmpz_one(power.get());
+            unsigned_long_t a = 1;
+            for(unsigned_long_t k = 0; k + 1 < p; k++)
+            {
+                table[a] = power;
+                fmpz_mul(power.get(), power.get(), padic_unit(w));
+                fmpz_mod(power.get(), power.get(), pN.get());
+                a = n_mulmod2(a, fmpz_get_ui(primitiveRoot().get()), p);
+            }
+            padic_clear(g);
+            padic_clear(w);
+
+            std::unique_lock lock(_teichmullerMutex);
+            _teichmuller = std::move(table);
+            _teichmullerPrec = prec;
+        }
+
+        //! @brief The precision of the Teichmüller table, 0 if there is none.
+        signed_long_t teichmullerPrec() const
+        {
+            std::shared_lock lock(_teichmullerMutex);
+            return _teichmullerPrec;
+        }
+
+        //! @brief Set rop = ω(a) mod p^prec from the table.
+        //! @return False, leaving rop alone, if the table does not reach precision prec.
+        bool lookupTeichmuller(fmpz_t rop, const fmpz_t a, signed_long_t prec) const
+        {
+            std::shared_lock lock(_teichmullerMutex);
+            if(prec > _teichmullerPrec)
+            {
+                return false;
+            }
+            fmpz_set(rop, _teichmuller[fmpz_fdiv_ui(a, _teichmuller.size())].get());
+            if(prec < _teichmullerPrec)
+            {
+                fmpz_t pN;
+                fmpz_init(pN);
+                fmpz_pow_ui(pN, _ctx->p, prec);
+                fmpz_mod(rop, rop, pN);
+                fmpz_clear(pN);
+            }
+            return true;
+        }
+
+        //! @brief The multiplicative order of a modulo p.
+        //! @details Starts from p - 1 and strips every prime factor q while a^(m/q) = 1.
+        Fmpz order(const Fmpz& a) const
+        {
+            Fmpz m;
+            fmpz_t r, e;
+            fmpz_init(r);
+            fmpz_init(e);
+            fmpz_mod(r, a.get(), _ctx->p);
+            if(fmpz_is_zero(r))
+            {
+                fmpz_clear(r);
+                fmpz_clear(e);
+                throw std::domain_error("Zero has no multiplicative order.");
+            }
+            fmpz_sub_ui(m.get(), _ctx->p, 1);
+            for(const auto& [q, k] : unitGroupFactors())
+            {
+                for(unsigned_long_t i = 0; i < k; i++)
+                {
+                    fmpz_divexact(e, m.get(), q.get());
+                    fmpz_powm(r, a.get(), e, _ctx->p);
+                    if(!fmpz_is_one(r))
+                    {
+                        break;
+                    }
+                    fmpz_swap(m.get(), e);
+                }
+            }
+            fmpz_clear(r);
+            fmpz_clear(e);
+            return m;
+        }
+    };
+
+    //! @brief Per-element outcome of invert_batch.
+    enum class PadicInvertStatus : uint8_t
+    {
+        OK,
+        ZERO,           // not invertible, left unchanged
+        LOW_PRECISION   // the inverse vanishes at the precision of the element, set to zero
     };
 
+    class PadicAccumulator;
+    class PadicDigits;
+    class PadicSortKey;
+    class PadicRandom;
+    struct _ResidueRoots;
+    class PadicDlog;
+    class _SquareClasses;
+    struct PadicQuadraticInvariants;
+    class MultiPrimeConverter;
+    class CrtNumber;
+    class PadicFactorial;
+
     class PadicNumber 
     {
     private:
@@ -179,6 +579,281 @@ namespace flint
             return _ctx;
         }
 
+        // Scalar operands work on the unit with the _ui/_si variants of the fmpz functions,
+        // so no PadicNumber temporary is built for them.
+        static void _scalarSet(fmpz_t rop, const unsigned_long_t c) { fmpz_set_ui(rop, c); }
+        static void _scalarSet(fmpz_t rop, const signed_long_t c) { fmpz_set_si(rop, c); }
+        static void _scalarSet(fmpz_t rop, const Fmpz& c) { fmpz_set(rop, c.get()); }
+
+        static bool _scalarIsZero(const unsigned_long_t c) { return c == 0; }
+        static bool _scalarIsZero(const signed_long_t c) { return c == 0; }
+        static bool _scalarIsZero(const Fmpz& c) { return fmpz_is_zero(c.get()); }
+
+        static void _scalarMul(fmpz_t rop, const fmpz_t op, const unsigned_long_t c) { fmpz_mul_ui(rop, op, c); }
+        static void _scalarMul(fmpz_t rop, const fmpz_t op, const signed_long_t c) { fmpz_mul_si(rop, op, c); }
+        static void _scalarMul(fmpz_t rop, const fmpz_t op, const Fmpz& c) { fmpz_mul(rop, op, c.get()); }
+
+        static void _scalarAdd(fmpz_t rop, const fmpz_t op, const unsigned_long_t c) { fmpz_add_ui(rop, op, c); }
+        static void _scalarAdd(fmpz_t rop, const fmpz_t op, const signed_long_t c) { fmpz_add_si(rop, op, c); }
+        static void _scalarAdd(fmpz_t rop, const fmpz_t op, const Fmpz& c) { fmpz_add(rop, op, c.get()); }
+
+        static void _scalarSub(fmpz_t rop, const fmpz_t op, const unsigned_long_t c) { fmpz_sub_ui(rop, op, c); }
+        static void _scalarSub(fmpz_t rop, const fmpz_t op, const signed_long_t c) { fmpz_sub_si(rop, op, c); }
+        static void _scalarSub(fmpz_t rop, const fmpz_t op, const Fmpz& c) { fmpz_sub(rop, op, c.get()); }
+
+        // rop += op·c
+        static void _scalarAddmul(fmpz_t rop, const fmpz_t op, const unsigned_long_t c) { fmpz_addmul_ui(rop, op, c); }
+        static void _scalarAddmul(fmpz_t rop, const fmpz_t op, const signed_long_t c) { fmpz_addmul_si(rop, op, c); }
+        static void _scalarAddmul(fmpz_t rop, const fmpz_t op, const Fmpz& c) { fmpz_addmul(rop, op, c.get()); }
+
+        // rop -= op·c
+        static void _scalarSubmul(fmpz_t rop, const fmpz_t op, const unsigned_long_t c) { fmpz_submul_ui(rop, op, c); }
+        static void _scalarSubmul(fmpz_t rop, const fmpz_t op, const signed_long_t c) { fmpz_submul_si(rop, op, c); }
+        static void _scalarSubmul(fmpz_t rop, const fmpz_t op, const Fmpz& c) { fmpz_submul(rop, op, c.get()); }
+
+        template<std::integral T>
+        static auto _word(const T c)
+        {
+            if constexpr(std::is_signed_v<T>)
+            {
+                return static_cast<signed_long_t>(c);
+            }
+            else
+            {
+                return static_cast<unsigned_long_t>(c);
+            }
+        }
+
+        //! @brief y = x + c, or y = x - c if negate is set.
+        template<typename S>
+        static PadicNumber _addScalar(const PadicNumber& x, const S& c, bool negate)
+        {
+            PadicNumber y(x.getContext());
+            const padic_ctx_t& ctx = x._getContext();
+            fmpz* u = padic_unit(y._val);
+            const signed_long_t v = padic_val(x._val);
+
+            if(padic_is_zero(x._val))
+            {
+                _scalarSet(u, c);
+                if(negate)
+                {
+                    fmpz_neg(u, u);
+                }
+                _padic_canonicalise(y._val, ctx);
+            }
+            else if(v < 0)
+            {
+                // c·p^-v is divisible by p, so the sum is still a unit at valuation v
+                fmpz_t pv;
+                const int alloc = _padic_ctx_pow_ui(pv, -v, ctx);
+                fmpz_set(u, padic_unit(x._val));
+                negate ? _scalarSubmul(u, pv, c) : _scalarAddmul(u, pv, c);
+                padic_val(y._val) = v;
+                if(alloc)
+                {
+                    fmpz_clear(pv);
+                }
+            }
+            else if(v == 0)
+            {
+                negate ? _scalarSub(u, padic_unit(x._val), c) : _scalarAdd(u, padic_unit(x._val), c);
+                _padic_canonicalise(y._val, ctx);
+            }
+            else
+            {
+                fmpz_t pv;
+                const int alloc = _padic_ctx_pow_ui(pv, v, ctx);
+                _scalarSet(u, c);
+                negate ? fmpz_submul(u, padic_unit(x._val), pv) : fmpz_addmul(u, padic_unit(x._val), pv);
+                if(negate)
+                {
+                    fmpz_neg(u, u);
+                }
+                _padic_canonicalise(y._val, ctx);
+                if(alloc)
+                {
+                    fmpz_clear(pv);
+                }
+            }
+            _padic_reduce(y._val, ctx);
+            return y;
+        }
+
+        //! @brief y = x·c.
+        template<typename S>
+        static PadicNumber _mulScalar(const PadicNumber& x, const S& c)
+        {
+            PadicNumber y(x.getContext());
+            if(!padic_is_zero(x._val) && !_scalarIsZero(c))
+            {
+                _scalarMul(padic_unit(y._val), padic_unit(x._val), c);
+                padic_val(y._val) = padic_val(x._val);
+                _padic_canonicalise(y._val, x._getContext());
+                _padic_reduce(y._val, x._getContext());
+            }
+            return y;
+        }
+
+        //! @brief y = x / c.
+        template<typename S>
+        static PadicNumber _divScalar(const PadicNumber& x, const S& c)
+        {
+            if(_scalarIsZero(c))
+            {
+                throw std::domain_error("Division by zero.");
+            }
+            PadicNumber y(x.getContext());
+            const padic_ctx_t& ctx = x._getContext();
+            if(padic_is_zero(x._val))
+            {
+                return y;
+            }
+
+            fmpz_t d;
+            fmpz_init(d);
+            _scalarSet(d, c);
+            const signed_long_t v = padic_val(x._val) - fmpz_remove(d, d, ctx->p);
+            if(v < padic_prec(y._val))
+            {
+                fmpz_t pN;
+                const int alloc = _padic_ctx_pow_ui(pN, padic_prec(y._val) - v, ctx);
+                fmpz_invmod(d, d, pN);
+                fmpz_mul(padic_unit(y._val), padic_unit(x._val), d);
+                fmpz_mod(padic_unit(y._val), padic_unit(y._val), pN);
+                padic_val(y._val) = v;
+                if(alloc)
+                {
+                    fmpz_clear(pN);
+                }
+            }
+            fmpz_clear(d);
+            return y;
+        }
+
+        //! @brief y = c / x.
+        template<typename S>
+        static PadicNumber _scalarDiv(const S& c, const PadicNumber& x)
+        {
+            if(padic_is_zero(x._val))
+            {
+                throw std::domain_error("Division by zero.");
+            }
+            PadicNumber y(x.getContext());
+            if(!_scalarIsZero(c))
+            {
+                padic_inv(y._val, x._val, x._getContext());
+                if(!padic_is_zero(y._val))
+                {
+                    _scalarMul(padic_unit(y._val), padic_unit(y._val), c);
+                    _padic_canonicalise(y._val, x._getContext());
+                    _padic_reduce(y._val, x._getContext());
+                }
+            }
+            return y;
+        }
+
+        //! @brief S += a·b·p^e, leaving S unreduced.
+        static void _addmulShifted(fmpz_t S, const fmpz_t a, const fmpz_t b, signed_long_t e, fmpz_t tmp, const padic_ctx_t ctx)
+        {
+            if(e == 0)
+            {
+                fmpz_addmul(S, a, b);
+                return;
+            }
+            fmpz_t pe;
+            const int alloc = _padic_ctx_pow_ui(pe, e, ctx);
+            fmpz_mul(tmp, a, b);
+            fmpz_addmul(S, tmp, pe);
+            if(alloc)
+            {
+                fmpz_clear(pe);
+            }
+        }
+
+        //! @brief S += a·p^e, leaving S unreduced.
+        static void _addShifted(fmpz_t S, const fmpz_t a, signed_long_t e, const padic_ctx_t ctx)
+        {
+            if(e == 0)
+            {
+                fmpz_add(S, S, a);
+                return;
+            }
+            fmpz_t pe;
+            const int alloc = _padic_ctx_pow_ui(pe, e, ctx);
+            fmpz_addmul(S, a, pe);
+            if(alloc)
+            {
+                fmpz_clear(pe);
+            }
+        }
+
+        //! @brief Set y = S·p^v with a single canonicalisation and reduction, S is consumed.
+        static void _setAccumulated(padic_t y, fmpz_t S, signed_long_t v, const padic_ctx_t ctx)
+        {
+            fmpz_swap(padic_unit(y), S);
+            padic_val(y) = v;
+            _padic_canonicalise(y, ctx);
+            _padic_reduce(y, ctx);
+        }
+
+        //! @brief Set xs[i] = nums[i]/den for i < n, den != 0, with one inversion of the unit part of den.
+        //! @details The inverse is taken modulo p^(N + v(den)) for the largest precision N among xs,
+        //!          which covers every quotient as v(num) >= 0.
+        static void _setFractions(PadicNumber* const* xs, const fmpz* const* nums, std::size_t n, const fmpz_t den)
+        {
+            if(n == 0)
+            {
+                return;
+            }
+            const padic_ctx_t& ctx = xs[0]->_getContext();
+            signed_long_t N = 0;
+            for(std::size_t i = 0; i < n; i++)
+            {
+                N = std::max(N, padic_prec(xs[i]->_val));
+            }
+
+            fmpz_t u, inv, pN;
+            fmpz_init(u);
+            fmpz_init(inv);
+            const signed_long_t v = fmpz_remove(u, den, ctx->p);
+            if(N + v > 0)
+            {
+                const int alloc = _padic_ctx_pow_ui(pN, N + v, ctx);
+                fmpz_invmod(inv, u, pN);
+                if(alloc)
+                {
+                    fmpz_clear(pN);
+                }
+            }
+
+            for(std::size_t i = 0; i < n; i++)
+            {
+                padic_struct* x = xs[i]->_val;
+                if(fmpz_is_zero(nums[i]))
+                {
+                    padic_zero(x);
+                    continue;
+                }
+                const signed_long_t w = fmpz_remove(u, nums[i], ctx->p);
+                if(w - v >= padic_prec(x))
+                {
+                    padic_zero(x);
+                    continue;
+                }
+                padic_val(x) = w - v;
+                const int alloc = _padic_ctx_pow_ui(pN, padic_prec(x) - padic_val(x), ctx);
+                fmpz_mul(padic_unit(x), u, inv);
+                fmpz_mod(padic_unit(x), padic_unit(x), pN);
+                if(alloc)
+                {
+                    fmpz_clear(pN);
+                }
+            }
+            fmpz_clear(u);
+            fmpz_clear(inv);
+        }
+
     public:
 
         //! @brief Constructor.
@@ -188,7 +863,41 @@ namespace flint
             padic_init2(_val, prec);
         }
 
-        ~PadicNumber() 
+        //! @brief Copy constructor, the copy keeps the precision of other.
+        PadicNumber(const PadicNumber& other) : _ctx(other._ctx)
+        {
+            padic_init2(_val, padic_prec(other._val));
+            padic_set(_val, other._val, _getContext());
+        }
+
+        //! @brief Move constructor, steals the unit of other.
+        PadicNumber(PadicNumber&& other) noexcept : _ctx(other._ctx)
+        {
+            padic_init2(_val, padic_prec(other._val));
+            padic_swap(_val, other._val);
+        }
+
+        //! @brief Copy assignment, takes over the context and precision of other.
+        PadicNumber& operator = (const PadicNumber& other)
+        {
+            if(this != &other)
+            {
+                _ctx = other._ctx;
+                padic_prec(_val) = padic_prec(other._val);
+                padic_set(_val, other._val, _getContext());
+            }
+            return *this;
+        }
+
+        //! @brief Move assignment, swaps the values.
+        PadicNumber& operator = (PadicNumber&& other) noexcept
+        {
+            _ctx.swap(other._ctx);
+            padic_swap(_val, other._val);
+            return *this;
+        }
+
+        ~PadicNumber()
         {
             padic_clear(_val);
         }
@@ -206,6 +915,13 @@ namespace flint
         {
             padic_set_si(_val, val, _getContext());
         }
+
+        //! @brief Set the value of the padic_t to a rational number.
+        //! @param val The value to set the padic_t to, its denominator may be divisible by p.
+        void set(const Fmpq& val) 
+        {
+            padic_set_fmpq(_val, val.get(), _getContext());
+        }
         
         //! @brief Print the value of the fmpz_t to a string.
         //! @param b The base to print the value in.
@@ -227,14 +943,92 @@ namespace flint
             return padic_get_prec(_val);
         }
 
+        //! @brief Multiply by p^k in place.
+        //! @details Only the valuation and the precision move, the unit is untouched.
+        PadicNumber& operator <<= (signed_long_t k)
+        {
+            if(!padic_is_zero(_val))
+            {
+                padic_val(_val) += k;
+            }
+            padic_prec(_val) += k;
+            return *this;
+        }
+
+        //! @brief Divide by p^k in place.
+        PadicNumber& operator >>= (signed_long_t k)
+        {
+            return *this <<= -k;
+        }
+
 
         friend PadicNumber operator + (const PadicNumber& lhs, const PadicNumber& rhs); 
         friend PadicNumber operator - (const PadicNumber& lhs, const PadicNumber& rhs);
         friend PadicNumber operator * (const PadicNumber& lhs, const PadicNumber& rhs);
         friend PadicNumber operator / (const PadicNumber& lhs, const PadicNumber& rhs);
 
+        template<std::integral T> friend PadicNumber operator + (const PadicNumber& lhs, T rhs);
+        template<std::integral T> friend PadicNumber operator + (T lhs, const PadicNumber& rhs);
+        template<std::integral T> friend PadicNumber operator - (const PadicNumber& lhs, T rhs);
+        template<std::integral T> friend PadicNumber operator - (T lhs, const PadicNumber& rhs);
+        template<std::integral T> friend PadicNumber operator * (const PadicNumber& lhs, T rhs);
+        template<std::integral T> friend PadicNumber operator * (T lhs, const PadicNumber& rhs);
+        template<std::integral T> friend PadicNumber operator / (const PadicNumber& lhs, T rhs);
+        template<std::integral T> friend PadicNumber operator / (T lhs, const PadicNumber& rhs);
+
+        friend PadicNumber operator + (const PadicNumber& lhs, const Fmpz& rhs);
+        friend PadicNumber operator + (const Fmpz& lhs, const PadicNumber& rhs);
+        friend PadicNumber operator - (const PadicNumber& lhs, const Fmpz& rhs);
+        friend PadicNumber operator - (const Fmpz& lhs, const PadicNumber& rhs);
+        friend PadicNumber operator * (const PadicNumber& lhs, const Fmpz& rhs);
+        friend PadicNumber operator * (const Fmpz& lhs, const PadicNumber& rhs);
+        friend PadicNumber operator / (const PadicNumber& lhs, const Fmpz& rhs);
+        friend PadicNumber operator / (const Fmpz& lhs, const PadicNumber& rhs);
+
+        friend PadicNumber shift(const PadicNumber& x, signed_long_t k);
+
+        friend class PadicAccumulator;
+        friend class PadicDigits;
+        friend class PadicSortKey;
+        friend class PadicRandom;
+        friend class PadicDlog;
+        friend class _SquareClasses;
+        friend class MultiPrimeConverter;
+        friend class CrtNumber;
+        friend class PadicFactorial;
+        friend CrtNumber operator + (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend CrtNumber operator - (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend CrtNumber operator * (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend CrtNumber inv(const CrtNumber& x);
+
+        friend PadicNumber dot(std::span<const PadicNumber> a, std::span<const PadicNumber> b, signed_long_t prec);
+        friend void axpy(const PadicNumber& alpha, std::span<const PadicNumber> x, std::span<PadicNumber> y);
+        friend bool equal(const PadicNumber& a, const PadicNumber& b, signed_long_t prec);
+        friend bool operator == (const PadicNumber& lhs, const PadicNumber& rhs);
+        friend std::size_t hash(const PadicNumber& x, signed_long_t prec);
+        friend void set_batch(std::span<PadicNumber> xs, std::span<const Fmpz> nums, const Fmpz& den);
+        friend void set_batch(std::span<PadicNumber> xs, std::span<const Fmpq> qs);
+        friend std::optional<Fmpq> to_rational(const PadicNumber& x, const Fmpz& num_bound, const Fmpz& den_bound);
+        friend std::optional<Fmpq> to_rational(const PadicNumber& x);
+        friend Fmpz order(const PadicNumber& x);
+        friend PadicNumber teichmuller(const PadicNumber& x, signed_long_t prec);
+        friend int hilbert_symbol(const PadicNumber& a, const PadicNumber& b);
+        friend std::vector<int> hilbert_symbol(std::span<const PadicNumber> a, std::span<const PadicNumber> b, unsigned threads);
+        friend PadicQuadraticInvariants quadratic_invariants(std::span<const PadicNumber> diagonal);
+        friend std::optional<PadicNumber> _nthRoot(const PadicNumber& x, unsigned_long_t n, signed_long_t prec, const _ResidueRoots* roots);
+        friend std::vector<std::optional<PadicNumber>> nth_root(std::span<const PadicNumber> xs, unsigned_long_t n, signed_long_t prec, unsigned threads);
+        friend PadicNumber principal_unit(const PadicNumber& x, signed_long_t prec);
+        friend std::vector<PadicNumber> roots_of_unity(std::shared_ptr<PadicContext> ctx, signed_long_t prec);
+        friend bool is_primitive(const PadicNumber& x);
+        friend std::vector<std::size_t> radix_order(std::span<const PadicNumber> xs, signed_long_t prec, unsigned threads);
+
+        friend std::vector<PadicInvertStatus> invert_batch(std::span<PadicNumber> x);
+        friend PadicNumber fma(const PadicNumber& a, const PadicNumber& b, const PadicNumber& c, signed_long_t prec);
+
         friend PadicNumber log(const PadicNumber& x, signed_long_t prec);
         friend PadicNumber exp(const PadicNumber& x, signed_long_t prec);
+        friend PadicNumber pow(const PadicNumber& x, const Fmpz& e, signed_long_t prec);
+        friend PadicNumber pow(const PadicNumber& x, const PadicNumber& a, signed_long_t prec);
 
         friend std::ostream& operator<<(std::ostream& os, PadicNumber& x)
         {
@@ -271,6 +1065,217 @@ namespace flint
         return y;
     }
 
+    template<std::integral T>
+    PadicNumber operator + (const PadicNumber& lhs, T rhs)
+    {
+        return PadicNumber::_addScalar(lhs, PadicNumber::_word(rhs), false);
+    }
+
+    template<std::integral T>
+    PadicNumber operator + (T lhs, const PadicNumber& rhs)
+    {
+        return PadicNumber::_addScalar(rhs, PadicNumber::_word(lhs), false);
+    }
+
+    template<std::integral T>
+    PadicNumber operator - (const PadicNumber& lhs, T rhs)
+    {
+        return PadicNumber::_addScalar(lhs, PadicNumber::_word(rhs), true);
+    }
+
+    template<std::integral T>
+    PadicNumber operator - (T lhs, const PadicNumber& rhs)
+    {
+        PadicNumber y = PadicNumber::_addScalar(rhs, PadicNumber::_word(lhs), true);
+        padic_neg(y._val, y._val, y._getContext());
+        return y;
+    }
+
+    template<std::integral T>
+    PadicNumber operator * (const PadicNumber& lhs, T rhs)
+    {
+        return PadicNumber::_mulScalar(lhs, PadicNumber::_word(rhs));
+    }
+
+    template<std::integral T>
+    PadicNumber operator * (T lhs, const PadicNumber& rhs)
+    {
+        return PadicNumber::_mulScalar(rhs, PadicNumber::_word(lhs));
+    }
+
+    template<std::integral T>
+    PadicNumber operator / (const PadicNumber& lhs, T rhs)
+    {
+        return PadicNumber::_divScalar(lhs, PadicNumber::_word(rhs));
+    }
+
+    template<std::integral T>
+    PadicNumber operator / (T lhs, const PadicNumber& rhs)
+    {
+        return PadicNumber::_scalarDiv(PadicNumber::_word(lhs), rhs);
+    }
+
+    PadicNumber operator + (const PadicNumber& lhs, const Fmpz& rhs)
+    {
+        return PadicNumber::_addScalar(lhs, rhs, false);
+    }
+
+    PadicNumber operator + (const Fmpz& lhs, const PadicNumber& rhs)
+    {
+        return PadicNumber::_addScalar(rhs, lhs, false);
+    }
+
+    PadicNumber operator - (const PadicNumber& lhs, const Fmpz& rhs)
+    {
+        return PadicNumber::_addScalar(lhs, rhs, true);
+    }
+
+    PadicNumber operator - (const Fmpz& lhs, const PadicNumber& rhs)
+    {
+        PadicNumber y = PadicNumber::_addScalar(rhs, lhs, true);
+        padic_neg(y._val, y._val, y._getContext());
+        return y;
+    }
+
+    PadicNumber operator * (const PadicNumber& lhs, const Fmpz& rhs)
+    {
+        return PadicNumber::_mulScalar(lhs, rhs);
+    }
+
+    PadicNumber operator * (const Fmpz& lhs, const PadicNumber& rhs)
+    {
+        return PadicNumber::_mulScalar(rhs, lhs);
+    }
+
+    PadicNumber operator / (const PadicNumber& lhs, const Fmpz& rhs)
+    {
+        return PadicNumber::_divScalar(lhs, rhs);
+    }
+
+    PadicNumber operator / (const Fmpz& lhs, const PadicNumber& rhs)
+    {
+        return PadicNumber::_scalarDiv(lhs, rhs);
+    }
+
+    //! @brief Check a ≡ b mod p^prec.
+    //! @details Only compares valuations when they differ and units modulo p^(prec - val)
+    //!          otherwise, the difference is never formed as a PadicNumber.
+    bool equal(const PadicNumber& a, const PadicNumber& b, signed_long_t prec)
+    {
+        const bool a_zero = padic_is_zero(a._val) || padic_val(a._val) >= prec;
+        const bool b_zero = padic_is_zero(b._val) || padic_val(b._val) >= prec;
+        if(a_zero || b_zero)
+        {
+            return a_zero && b_zero;
+        }
+        if(padic_val(a._val) != padic_val(b._val))
+        {
+            return false;
+        }
+
+        // units are reduced modulo p^(prec(x) - val(x)), so above both precisions they compare directly
+        if(prec >= padic_prec(a._val) && prec >= padic_prec(b._val))
+        {
+            return fmpz_equal(padic_unit(a._val), padic_unit(b._val));
+        }
+
+        fmpz_t d, pk;
+        fmpz_init(d);
+        fmpz_sub(d, padic_unit(a._val), padic_unit(b._val));
+        const int alloc = _padic_ctx_pow_ui(pk, prec - padic_val(a._val), a._getContext());
+        const bool result = fmpz_divisible(d, pk);
+        if(alloc)
+        {
+            fmpz_clear(pk);
+        }
+        fmpz_clear(d);
+        return result;
+    }
+
+    //! @brief Exact equality of the representations: precision, valuation and unit.
+    //! @details Use equal() to compare numbers of different precisions modulo a common p^prec.
+    bool operator == (const PadicNumber& lhs, const PadicNumber& rhs)
+    {
+        if(padic_prec(lhs._val) != padic_prec(rhs._val))
+        {
+            return false;
+        }
+        if(padic_is_zero(lhs._val) || padic_is_zero(rhs._val))
+        {
+            return padic_is_zero(lhs._val) && padic_is_zero(rhs._val);
+        }
+        return padic_val(lhs._val) == padic_val(rhs._val) && fmpz_equal(padic_unit(lhs._val), padic_unit(rhs._val));
+    }
+
+    //! @brief Hash of x truncated to x mod p^prec, all numbers of one ball of radius p^-prec hash together.
+    std::size_t hash(const PadicNumber& x, signed_long_t prec)
+    {
+        if(padic_is_zero(x._val) || padic_val(x._val) >= prec)
+        {
+            return _hashMix(0, 0);
+        }
+
+        const std::size_t seed = _hashMix(1, static_cast<std::uint64_t>(padic_val(x._val)));
+        if(prec >= padic_prec(x._val))
+        {
+            return _hash(padic_unit(x._val), seed);
+        }
+
+        fmpz_t u, pk;
+        fmpz_init(u);
+        const int alloc = _padic_ctx_pow_ui(pk, prec - padic_val(x._val), x._getContext());
+        fmpz_mod(u, padic_unit(x._val), pk);
+        const std::size_t h = _hash(u, seed);
+        if(alloc)
+        {
+            fmpz_clear(pk);
+        }
+        fmpz_clear(u);
+        return h;
+    }
+
+    //! @brief Hash functor for unordered containers keyed on balls of radius p^-prec.
+    struct PadicBallHash
+    {
+        signed_long_t prec;
+
+        std::size_t operator()(const PadicNumber& x) const
+        {
+            return hash(x, prec);
+        }
+    };
+
+    //! @brief Equality functor matching PadicBallHash.
+    struct PadicBallEqual
+    {
+        signed_long_t prec;
+
+        bool operator()(const PadicNumber& a, const PadicNumber& b) const
+        {
+            return equal(a, b, prec);
+        }
+    };
+
+    //! @brief Multiply x by p^k (divide for negative k).
+    //! @details The result has precision prec(x) + k, so the unit needs no reduction.
+    PadicNumber shift(const PadicNumber& x, signed_long_t k)
+    {
+        PadicNumber y(x.getContext(), padic_prec(x._val) + k);
+        fmpz_set(padic_unit(y._val), padic_unit(x._val));
+        padic_val(y._val) = padic_is_zero(x._val) ? 0 : padic_val(x._val) + k;
+        return y;
+    }
+
+    PadicNumber operator << (const PadicNumber& x, signed_long_t k)
+    {
+        return shift(x, k);
+    }
+
+    PadicNumber operator >> (const PadicNumber& x, signed_long_t k)
+    {
+        return shift(x, -k);
+    }
+
     PadicNumber log(const PadicNumber& x, signed_long_t prec = PADIC_DEFAULT_PREC) 
     {
         PadicNumber y(x.getContext(), prec);
@@ -292,4 +1297,3882 @@ namespace flint
         }
         return y;
     }
-}
\ No newline at end of file
+
+    //! @brief Raise x to an integer power.
+    //! @details Only the unit of x is exponentiated, and directly modulo p^(prec - e·val(x)),
+    //!          so every intermediate square is already truncated to the target precision.
+    //!          The unit power itself is fmpz_powm (GMP's sliding-window exponentiation).
+    //! @param e The exponent, may be negative if x is non-zero.
+    //! @param prec The precision of the result.
+    PadicNumber pow(const PadicNumber& x, const Fmpz& e, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        PadicNumber y(x.getContext(), prec);
+        const padic_ctx_t& ctx = x._getContext();
+
+        if(fmpz_is_zero(e.get()))
+        {
+            padic_one(y._val);
+            return y;
+        }
+        if(padic_is_zero(x._val))
+        {
+            if(fmpz_sgn(e.get()) < 0)
+            {
+                throw std::domain_error("Zero cannot be raised to a negative power.");
+            }
+            return y;
+        }
+
+        // val(x^e) = e·val(x), anything at or above prec truncates to zero
+        fmpz_t v;
+        fmpz_init(v);
+        fmpz_mul_si(v, e.get(), padic_val(x._val));
+        if(fmpz_cmp_si(v, prec) >= 0)
+        {
+            fmpz_clear(v);
+            return y;
+        }
+        if(!fmpz_fits_si(v))
+        {
+            fmpz_clear(v);
+            throw std::overflow_error("Valuation of the power does not fit into a word.");
+        }
+        const signed_long_t val = fmpz_get_si(v);
+        fmpz_clear(v);
+
+        fmpz_t pN;
+        const int alloc = _padic_ctx_pow_ui(pN, prec - val, ctx);
+
+        if(fmpz_sgn(e.get()) > 0)
+        {
+            fmpz_powm(padic_unit(y._val), padic_unit(x._val), e.get(), pN);
+        }
+        else
+        {
+            fmpz_t n;
+            fmpz_init(n);
+            fmpz_neg(n, e.get());
+            fmpz_invmod(padic_unit(y._val), padic_unit(x._val), pN);
+            fmpz_powm(padic_unit(y._val), padic_unit(y._val), n, pN);
+            fmpz_clear(n);
+        }
+        padic_val(y._val) = val;
+
+        if(alloc)
+        {
+            fmpz_clear(pN);
+        }
+        return y;
+    }
+
+    //! @brief Raise a principal unit x to a p-adic exponent a ∈ Z_p, x^a = exp(a·log(x)).
+    //! @details x must satisfy x ≡ 1 mod p (mod 4 if p = 2). Exponents with
+    //!          val(a) + val(x - 1) >= prec give 1 without any arithmetic, pure powers p^k
+    //!          are k successive p-th powers and word-size exponents use pow(x, Fmpz);
+    //!          only the remaining exponents go through exp and log.
+    //! @param a The exponent.
+    //! @param prec The precision of the result.
+    PadicNumber pow(const PadicNumber& x, const PadicNumber& a, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        const padic_ctx_t& ctx = x._getContext();
+
+        if(padic_val(a._val) < 0)
+        {
+            throw std::domain_error("The p-adic exponent must lie in Z_p.");
+        }
+
+        PadicNumber d(x.getContext(), prec);
+        padic_one(d._val);
+        padic_sub(d._val, x._val, d._val, ctx);
+        if(!padic_is_zero(d._val) && (padic_val(d._val) < 1 || (fmpz_equal_ui(ctx->p, 2) && padic_val(d._val) < 2)))
+        {
+            throw std::domain_error("x must be congruent to 1 mod p (mod 4 for p = 2).");
+        }
+
+        // x^a ≡ 1 mod p^(val(a) + val(x - 1)), which also covers a = 0 and x = 1
+        if(padic_is_zero(a._val) || padic_is_zero(d._val) || padic_val(a._val) + padic_val(d._val) >= prec)
+        {
+            PadicNumber y(x.getContext(), prec);
+            padic_one(y._val);
+            return y;
+        }
+
+        Fmpz n;
+        padic_get_fmpz(n.get(), a._val, ctx);
+
+        if(fmpz_is_one(padic_unit(a._val)))
+        {
+            PadicNumber y(x.getContext(), prec);
+            fmpz_t pN;
+            const int alloc = _padic_ctx_pow_ui(pN, prec, ctx);
+            fmpz_mod(padic_unit(y._val), padic_unit(x._val), pN);
+            for(signed_long_t i = 0; i < padic_val(a._val); i++)
+            {
+                fmpz_powm(padic_unit(y._val), padic_unit(y._val), ctx->p, pN);
+            }
+            if(alloc)
+            {
+                fmpz_clear(pN);
+            }
+            return y;
+        }
+        if(fmpz_bits(n.get()) <= FLINT_BITS)
+        {
+            return pow(x, n, prec);
+        }
+
+        PadicNumber t(x.getContext(), prec);
+        padic_mul(t._val, a._val, log(x, prec)._val, ctx);
+        return exp(t, prec);
+    }
+
+    //! @brief Dot product Σ a_i·b_i.
+    //! @details The smallest valuation of the products is found first, then all unit products
+    //!          are summed into one unreduced fmpz shifted to that valuation, and the sum is
+    //!          reduced modulo p^N once at the end instead of after every multiply and add.
+    //!          Products whose valuation is at least prec are skipped.
+    //! @param prec The precision of the result.
+    PadicNumber dot(std::span<const PadicNumber> a, std::span<const PadicNumber> b, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        if(a.size() != b.size())
+        {
+            throw std::invalid_argument("The vectors must have the same length.");
+        }
+        if(a.empty())
+        {
+            throw std::invalid_argument("The vectors must not be empty.");
+        }
+
+        PadicNumber y(a[0].getContext(), prec);
+        const padic_ctx_t& ctx = a[0]._getContext();
+
+        signed_long_t v = prec;
+        for(std::size_t i = 0; i < a.size(); i++)
+        {
+            if(!padic_is_zero(a[i]._val) && !padic_is_zero(b[i]._val))
+            {
+                v = std::min(v, padic_val(a[i]._val) + padic_val(b[i]._val));
+            }
+        }
+        if(v >= prec)
+        {
+            return y;
+        }
+
+        fmpz_t S, tmp;
+        fmpz_init(S);
+        fmpz_init(tmp);
+        for(std::size_t i = 0; i < a.size(); i++)
+        {
+            if(padic_is_zero(a[i]._val) || padic_is_zero(b[i]._val))
+            {
+                continue;
+            }
+            const signed_long_t vi = padic_val(a[i]._val) + padic_val(b[i]._val);
+            if(vi < prec)
+            {
+                PadicNumber::_addmulShifted(S, padic_unit(a[i]._val), padic_unit(b[i]._val), vi - v, tmp, ctx);
+            }
+        }
+        PadicNumber::_setAccumulated(y._val, S, v, ctx);
+
+        fmpz_clear(S);
+        fmpz_clear(tmp);
+        return y;
+    }
+
+    //! @brief y_i = alpha·x_i + y_i, each y_i keeps its precision.
+    //! @details Every element is formed as one unreduced sum at the smaller of the two
+    //!          valuations and reduced once, like fma.
+    void axpy(const PadicNumber& alpha, std::span<const PadicNumber> x, std::span<PadicNumber> y)
+    {
+        if(x.size() != y.size())
+        {
+            throw std::invalid_argument("The vectors must have the same length.");
+        }
+        if(padic_is_zero(alpha._val))
+        {
+            return;
+        }
+
+        const padic_ctx_t& ctx = alpha._getContext();
+        fmpz_t S, tmp;
+        fmpz_init(S);
+        fmpz_init(tmp);
+        for(std::size_t i = 0; i < x.size(); i++)
+        {
+            if(padic_is_zero(x[i]._val))
+            {
+                continue;
+            }
+            const signed_long_t vx = padic_val(alpha._val) + padic_val(x[i]._val);
+            if(vx >= padic_prec(y[i]._val))
+            {
+                continue;
+            }
+            const signed_long_t vy = padic_is_zero(y[i]._val) ? vx : padic_val(y[i]._val);
+            const signed_long_t v = std::min(vx, vy);
+
+            fmpz_zero(S);
+            PadicNumber::_addmulShifted(S, padic_unit(alpha._val), padic_unit(x[i]._val), vx - v, tmp, ctx);
+            if(!padic_is_zero(y[i]._val))
+            {
+                PadicNumber::_addShifted(S, padic_unit(y[i]._val), vy - v, ctx);
+            }
+            PadicNumber::_setAccumulated(y[i]._val, S, v, ctx);
+        }
+        fmpz_clear(S);
+        fmpz_clear(tmp);
+    }
+
+    //! @brief Fused multiply-add a·b + c with a single reduction.
+    //! @param prec The precision of the result.
+    PadicNumber fma(const PadicNumber& a, const PadicNumber& b, const PadicNumber& c, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        PadicNumber y(a.getContext(), prec);
+        const padic_ctx_t& ctx = a._getContext();
+
+        const bool ab = !padic_is_zero(a._val) && !padic_is_zero(b._val) && padic_val(a._val) + padic_val(b._val) < prec;
+        if(!ab)
+        {
+            padic_set(y._val, c._val, ctx);
+            return y;
+        }
+
+        const signed_long_t vab = padic_val(a._val) + padic_val(b._val);
+        const signed_long_t vc = padic_is_zero(c._val) ? vab : padic_val(c._val);
+        const signed_long_t v = std::min(vab, vc);
+
+        fmpz_t S, tmp;
+        fmpz_init(S);
+        fmpz_init(tmp);
+        PadicNumber::_addmulShifted(S, padic_unit(a._val), padic_unit(b._val), vab - v, tmp, ctx);
+        if(!padic_is_zero(c._val))
+        {
+            PadicNumber::_addShifted(S, padic_unit(c._val), vc - v, ctx);
+        }
+        PadicNumber::_setAccumulated(y._val, S, v, ctx);
+
+        fmpz_clear(S);
+        fmpz_clear(tmp);
+        return y;
+    }
+
+    //! @brief Unreduced running sum of PadicNumbers for long summation chains.
+    //! @details Every term x is added as unit(x)·p^(val(x) - floor) to a plain fmpz, the sum
+    //!          is only reduced modulo p^(prec - floor) when its size passes the limb threshold
+    //!          or when it is read out, instead of on every addition.
+    class PadicAccumulator
+    {
+    private:
+        std::shared_ptr<PadicContext> _ctx;
+        signed_long_t _floor;
+        signed_long_t _prec;
+        unsigned_long_t _limbs;
+        Fmpz _modulus;
+        Fmpz _sum;
+
+        const padic_ctx_t& _getContext() const
+        {
+            return _ctx.get()->get();
+        }
+
+        void _add(const PadicNumber& x, bool negate)
+        {
+            if(padic_is_zero(x._val) || padic_val(x._val) >= _prec)
+            {
+                return;
+            }
+            if(padic_val(x._val) < _floor)
+            {
+                throw std::domain_error("The valuation of the term is below the floor of the accumulator.");
+            }
+
+            const signed_long_t e = padic_val(x._val) - _floor;
+            fmpz_t pe;
+            const int alloc = _padic_ctx_pow_ui(pe, e, _getContext());
+            if(negate)
+            {
+                fmpz_submul(_sum.get(), padic_unit(x._val), pe);
+            }
+            else
+            {
+                fmpz_addmul(_sum.get(), padic_unit(x._val), pe);
+            }
+            if(alloc)
+            {
+                fmpz_clear(pe);
+            }
+
+            if(static_cast<unsigned_long_t>(fmpz_size(_sum.get())) > _limbs)
+            {
+                fmpz_mod(_sum.get(), _sum.get(), _modulus.get());
+            }
+        }
+
+    public:
+        //! @param floor The smallest valuation of the terms that will be added.
+        //! @param prec The precision of the sum.
+        //! @param limbs Reduce once the sum is larger than this many limbs,
+        //!        0 picks 2·size(p^(prec - floor)) + 1 limbs.
+        explicit PadicAccumulator(std::shared_ptr<PadicContext> ctx, signed_long_t floor = 0, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned_long_t limbs = 0)
+            : _ctx(ctx), _floor(floor), _prec(prec), _limbs(limbs)
+        {
+            if(prec <= floor)
+            {
+                throw std::invalid_argument("The precision must be larger than the floor.");
+            }
+            fmpz_pow_ui(_modulus.get(), _getContext()->p, prec - floor);
+            if(_limbs == 0)
+            {
+                _limbs = 2 * fmpz_size(_modulus.get()) + 1;
+            }
+        }
+
+        PadicAccumulator& operator += (const PadicNumber& x)
+        {
+            _add(x, false);
+            return *this;
+        }
+
+        PadicAccumulator& operator -= (const PadicNumber& x)
+        {
+            _add(x, true);
+            return *this;
+        }
+
+        //! @brief Start a new sum.
+        void reset()
+        {
+            fmpz_zero(_sum.get());
+        }
+
+        //! @brief The reduced sum, the accumulator itself stays unchanged.
+        PadicNumber value() const
+        {
+            PadicNumber y(_ctx, _prec);
+            fmpz_mod(padic_unit(y._val), _sum.get(), _modulus.get());
+            padic_val(y._val) = _floor;
+            _padic_canonicalise(y._val, _getContext());
+            _padic_reduce(y._val, _getContext());
+            return y;
+        }
+    };
+
+    //! @brief Invert every element of x in place with Montgomery's trick.
+    //! @details Valuations are split off, so only the units take part: one fmpz_invmod and
+    //!          3(n - 1) multiplications modulo the largest p^(prec + val) of the batch, after
+    //!          which each inverse is reduced to its own precision.
+    //! @return The status of every element, zero elements are left untouched.
+    std::vector<PadicInvertStatus> invert_batch(std::span<PadicNumber> x)
+    {
+        std::vector<PadicInvertStatus> status(x.size(), PadicInvertStatus::OK);
+        std::vector<std::size_t> units;
+        units.reserve(x.size());
+
+        signed_long_t N = 0;
+        for(std::size_t i = 0; i < x.size(); i++)
+        {
+            if(padic_is_zero(x[i]._val))
+            {
+                status[i] = PadicInvertStatus::ZERO;
+            }
+            else if(-padic_val(x[i]._val) >= padic_prec(x[i]._val))
+            {
+                status[i] = PadicInvertStatus::LOW_PRECISION;
+                padic_zero(x[i]._val);
+            }
+            else
+            {
+                units.push_back(i);
+                N = std::max(N, padic_prec(x[i]._val) + padic_val(x[i]._val));
+            }
+        }
+        if(units.empty())
+        {
+            return status;
+        }
+
+        const padic_ctx_t& ctx = x[units[0]]._getContext();
+        const slong n = static_cast<slong>(units.size());
+
+        fmpz_t M, inv, tmp;
+        fmpz_init(M);
+        fmpz_init(inv);
+        fmpz_init(tmp);
+        fmpz_pow_ui(M, ctx->p, N);
+
+        // prefix products c_k = u_0···u_k
+        fmpz* c = _fmpz_vec_init(n);
+        fmpz_set(c + 0, padic_unit(x[units[0]]._val));
+        for(slong k = 1; k < n; k++)
+        {
+            fmpz_mul(c + k, c + k - 1, padic_unit(x[units[k]]._val));
+            fmpz_mod(c + k, c + k, M);
+        }
+
+        fmpz_invmod(inv, c + n - 1, M);
+        for(slong k = n - 1; k >= 0; k--)
+        {
+            padic_struct* xk = x[units[k]]._val;
+            if(k > 0)
+            {
+                fmpz_mul(tmp, inv, c + k - 1);
+                fmpz_mul(inv, inv, padic_unit(xk));
+                fmpz_mod(inv, inv, M);
+                fmpz_swap(padic_unit(xk), tmp);
+            }
+            else
+            {
+                fmpz_swap(padic_unit(xk), inv);
+            }
+            padic_val(xk) = -padic_val(xk);
+            _padic_reduce(xk, ctx);
+        }
+
+        _fmpz_vec_clear(c, n);
+        fmpz_clear(M);
+        fmpz_clear(inv);
+        fmpz_clear(tmp);
+        return status;
+    }
+
+    //! @brief Run fn(begin, end) on contiguous chunks of [0, n) in parallel.
+    //! @details Exceptions thrown by fn are rethrown on the calling thread, and every worker
+    //!          releases the FLINT thread-local caches before it exits.
+    //! @param threads The number of threads, 0 uses std::thread::hardware_concurrency().
+    template<typename F>
+    void parallel_for(std::size_t n, F&& fn, unsigned threads = 0)
+    {
+        if(threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned>(std::min<std::size_t>(threads, n));
+        if(threads <= 1)
+        {
+            if(n > 0)
+            {
+                fn(std::size_t(0), n);
+            }
+            return;
+        }
+
+        const std::size_t chunk = (n + threads - 1) / threads;
+        std::vector<std::exception_ptr> errors(threads);
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        for(unsigned t = 0; t < threads && t * chunk < n; t++)
+        {
+            workers.emplace_back([&fn, &errors, t, begin = t * chunk, end = std::min(n, (t + 1) * chunk)]()
+            {
+                try
+                {
+                    fn(begin, end);
+                }
+                catch(...)
+                {
+                    errors[t] = std::current_exception();
+                }
+                flint_cleanup();
+            });
+        }
+        for(auto& worker : workers)
+        {
+            worker.join();
+        }
+        for(auto& error : errors)
+        {
+            if(error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    //! @brief Base-p digit strings of PadicNumbers.
+    //! @details The key of x holds its digits at p^floor, ..., p^(prec - 1), least significant
+    //!          first, so two numbers agree on the first k - floor digits exactly when
+    //!          val(x - y) >= k. p must fit into a word.
+    class PadicDigits
+    {
+    private:
+        std::shared_ptr<PadicContext> _ctx;
+        signed_long_t _prec;
+        signed_long_t _floor;
+        unsigned_long_t _p;
+        unsigned_long_t _chunk;     // largest power of p that fits into a word
+        unsigned _chunkDigits;
+
+        const padic_ctx_t& _getContext() const
+        {
+            return _ctx.get()->get();
+        }
+
+    public:
+        using Key = std::vector<unsigned_long_t>;
+
+        PadicDigits(std::shared_ptr<PadicContext> ctx, signed_long_t prec, signed_long_t floor = 0)
+            : _ctx(ctx), _prec(prec), _floor(floor)
+        {
+            if(prec <= floor)
+            {
+                throw std::invalid_argument("The precision must be larger than the floor.");
+            }
+            if(!fmpz_abs_fits_ui(_getContext()->p))
+            {
+                throw std::invalid_argument("The prime must fit into a word.");
+            }
+            _p = fmpz_get_ui(_getContext()->p);
+            _chunk = _p;
+            _chunkDigits = 1;
+            while(_chunk <= UWORD_MAX / _p)
+            {
+                _chunk *= _p;
+                _chunkDigits++;
+            }
+        }
+
+        signed_long_t prec() const
+        {
+            return _prec;
+        }
+
+        signed_long_t floor() const
+        {
+            return _floor;
+        }
+
+        unsigned_long_t base() const
+        {
+            return _p;
+        }
+
+        //! @brief The largest power of p that fits into a word.
+        unsigned_long_t chunk() const
+        {
+            return _chunk;
+        }
+
+        //! @brief The number of base-p digits in chunk().
+        unsigned chunkDigits() const
+        {
+            return _chunkDigits;
+        }
+
+        //! @brief The number of digits in a key, prec - floor.
+        std::size_t length() const
+        {
+            return static_cast<std::size_t>(_prec - _floor);
+        }
+
+        //! @brief Write the digits of x into key, which must hold length() entries.
+        //! @details The unit is split into word-size chunks p^k with one fmpz division each,
+        //!          the digits of a chunk are then peeled off with word arithmetic.
+        void get(std::span<unsigned_long_t> key, const PadicNumber& x) const
+        {
+            std::fill(key.begin(), key.end(), 0);
+            if(padic_is_zero(x._val) || padic_val(x._val) >= _prec)
+            {
+                return;
+            }
+            if(padic_val(x._val) < _floor)
+            {
+                throw std::domain_error("The valuation is below the floor of the digits.");
+            }
+
+            fmpz_t r, pN;
+            fmpz_init(r);
+            const int alloc = _padic_ctx_pow_ui(pN, _prec - padic_val(x._val), _getContext());
+            fmpz_mod(r, padic_unit(x._val), pN);
+            if(alloc)
+            {
+                fmpz_clear(pN);
+            }
+
+            std::size_t i = static_cast<std::size_t>(padic_val(x._val) - _floor);
+            while(i < key.size() && !fmpz_is_zero(r))
+            {
+                unsigned_long_t w = fmpz_fdiv_ui(r, _chunk);
+                fmpz_fdiv_q_ui(r, r, _chunk);
+                for(unsigned j = 0; j < _chunkDigits && i < key.size(); j++, i++)
+                {
+                    key[i] = w % _p;
+                    w /= _p;
+                }
+            }
+            fmpz_clear(r);
+        }
+
+        Key operator()(const PadicNumber& x) const
+        {
+            Key key(length());
+            get(key, x);
+            return key;
+        }
+    };
+
+    //! @brief Index of PadicNumbers by their base-p digits, for ball queries.
+    //! @details The ball {y : val(y - x) >= k} is the set of numbers sharing the digits of x
+    //!          below p^k, so a radix tree over the digit strings, least significant digit first,
+    //!          answers it with one prefix walk. Keys hold the digits from p^floor up to p^prec
+    //!          and the numbers are read at that precision. p must fit into a word.
+    //!          Queries take a shared lock and may run concurrently, insertions an exclusive one.
+    class PadicBallIndex
+    {
+    private:
+        using Key = PadicDigits::Key;
+
+        struct Node
+        {
+            Key label;                                  // digits on the edge into this node
+            std::vector<std::unique_ptr<Node>> children; // ordered by the first digit of their label
+            std::vector<std::size_t> ids;               // entries whose key ends here
+            std::size_t size = 0;                       // entries in the subtree
+        };
+
+        PadicDigits _digits;
+        std::vector<PadicNumber> _items;
+        Node _root;
+        mutable std::shared_mutex _mutex;
+
+        std::size_t _depth() const
+        {
+            return _digits.length();
+        }
+
+        Key _key(const PadicNumber& x) const
+        {
+            return _digits(x);
+        }
+
+        static Node* _child(const Node* node, unsigned_long_t digit)
+        {
+            auto it = std::lower_bound(node->children.begin(), node->children.end(), digit,
+                [](const std::unique_ptr<Node>& c, unsigned_long_t d) { return c->label[0] < d; });
+            return it != node->children.end() && (*it)->label[0] == digit ? it->get() : nullptr;
+        }
+
+        static void _addChild(Node* node, std::unique_ptr<Node> child)
+        {
+            auto it = std::lower_bound(node->children.begin(), node->children.end(), child->label[0],
+                [](const std::unique_ptr<Node>& c, unsigned_long_t d) { return c->label[0] < d; });
+            node->children.insert(it, std::move(child));
+        }
+
+        void _insert(const Key& key, std::size_t id)
+        {
+            Node* node = &_root;
+            node->size++;
+            std::size_t d = 0;
+            while(d < key.size())
+            {
+                Node* c = _child(node, key[d]);
+                if(c == nullptr)
+                {
+                    auto leaf = std::make_unique<Node>();
+                    leaf->label.assign(key.begin() + d, key.end());
+                    leaf->ids.push_back(id);
+                    leaf->size = 1;
+                    _addChild(node, std::move(leaf));
+                    return;
+                }
+
+                std::size_t l = 1;
+                while(l < c->label.size() && c->label[l] == key[d + l])
+                {
+                    l++;
+                }
+                if(l < c->label.size())
+                {
+                    // split the edge after l digits
+                    auto it = std::find_if(node->children.begin(), node->children.end(),
+                        [c](const std::unique_ptr<Node>& n) { return n.get() == c; });
+                    auto lower = std::move(*it);
+                    auto mid = std::make_unique<Node>();
+                    mid->label.assign(lower->label.begin(), lower->label.begin() + l);
+                    mid->size = lower->size + 1;
+                    lower->label.erase(lower->label.begin(), lower->label.begin() + l);
+
+                    auto leaf = std::make_unique<Node>();
+                    leaf->label.assign(key.begin() + d + l, key.end());
+                    leaf->ids.push_back(id);
+                    leaf->size = 1;
+
+                    _addChild(mid.get(), std::move(lower));
+                    _addChild(mid.get(), std::move(leaf));
+                    *it = std::move(mid);
+                    return;
+                }
+                node = c;
+                node->size++;
+                d += l;
+            }
+            node->ids.push_back(id);
+        }
+
+        //! @brief Build the subtree below node from ids[lo, hi), sorted by key, sharing the first d digits.
+        void _build(Node* node, const std::vector<Key>& keys, const std::vector<std::size_t>& ids, std::size_t lo, std::size_t hi, std::size_t d)
+        {
+            node->size = hi - lo;
+            if(d == _depth())
+            {
+                node->ids.assign(ids.begin() + lo, ids.begin() + hi);
+                return;
+            }
+            std::size_t a = lo;
+            while(a < hi)
+            {
+                std::size_t b = a + 1;
+                while(b < hi && keys[b][d] == keys[a][d])
+                {
+                    b++;
+                }
+                // the common prefix of a sorted range is the one of its first and last key
+                std::size_t l = 1;
+                while(d + l < _depth() && keys[a][d + l] == keys[b - 1][d + l])
+                {
+                    l++;
+                }
+                auto child = std::make_unique<Node>();
+                child->label.assign(keys[a].begin() + d, keys[a].begin() + d + l);
+                _build(child.get(), keys, ids, a, b, d + l);
+                node->children.push_back(std::move(child));
+                a = b;
+            }
+        }
+
+        static void _collect(const Node* node, std::vector<std::size_t>& out)
+        {
+            std::vector<const Node*> stack{ node };
+            while(!stack.empty())
+            {
+                const Node* n = stack.back();
+                stack.pop_back();
+                out.insert(out.end(), n->ids.begin(), n->ids.end());
+                for(const auto& c : n->children)
+                {
+                    stack.push_back(c.get());
+                }
+            }
+        }
+
+        //! @brief The node whose subtree holds the entries sharing the first m digits of key, or nullptr.
+        const Node* _find(const Key& key, std::size_t m) const
+        {
+            const Node* node = &_root;
+            std::size_t d = 0;
+            while(d < m)
+            {
+                const Node* c = _child(node, key[d]);
+                if(c == nullptr)
+                {
+                    return nullptr;
+                }
+                const std::size_t l = std::min(c->label.size(), m - d);
+                if(!std::equal(c->label.begin(), c->label.begin() + l, key.begin() + d))
+                {
+                    return nullptr;
+                }
+                node = c;
+                d += l;
+            }
+            return node;
+        }
+
+    public:
+        //! @param prec The precision at which numbers are indexed.
+        //! @param floor The smallest valuation of the indexed numbers.
+        explicit PadicBallIndex(std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC, signed_long_t floor = 0)
+            : _digits(ctx, prec, floor)
+        {
+        }
+
+        //! @brief Add one number.
+        //! @return Its id, ids count up from 0 in insertion order.
+        std::size_t insert(const PadicNumber& x)
+        {
+            const Key key = _key(x);
+            std::unique_lock lock(_mutex);
+            const std::size_t id = _items.size();
+            _items.push_back(x);
+            _insert(key, id);
+            return id;
+        }
+
+        //! @brief Add many numbers at once.
+        //! @details The digit strings are computed in parallel. An empty index is then built
+        //!          bottom-up from the sorted keys, otherwise the keys are inserted one by one.
+        //! @return The id of the first number, the others follow consecutively.
+        std::size_t insert(std::span<const PadicNumber> xs, unsigned threads = 0)
+        {
+            std::vector<Key> keys(xs.size());
+            parallel_for(xs.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    keys[i] = _key(xs[i]);
+                }
+            }, threads);
+
+            std::unique_lock lock(_mutex);
+            const std::size_t first = _items.size();
+            _items.insert(_items.end(), xs.begin(), xs.end());
+
+            if(_root.size == 0 && !xs.empty())
+            {
+                std::vector<std::size_t> order(xs.size());
+                for(std::size_t i = 0; i < order.size(); i++)
+                {
+                    order[i] = i;
+                }
+                std::sort(order.begin(), order.end(), [&keys](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+
+                std::vector<Key> sorted(keys.size());
+                std::vector<std::size_t> ids(keys.size());
+                for(std::size_t i = 0; i < order.size(); i++)
+                {
+                    sorted[i] = std::move(keys[order[i]]);
+                    ids[i] = first + order[i];
+                }
+                _build(&_root, sorted, ids, 0, ids.size(), 0);
+            }
+            else
+            {
+                for(std::size_t i = 0; i < keys.size(); i++)
+                {
+                    _insert(keys[i], first + i);
+                }
+            }
+            return first;
+        }
+
+        //! @brief The ids of all entries y with val(y - x) >= k.
+        std::vector<std::size_t> ball(const PadicNumber& x, signed_long_t k) const
+        {
+            const Key key = _key(x);
+            const std::size_t m = static_cast<std::size_t>(std::clamp(k - _digits.floor(), signed_long_t(0), _digits.prec() - _digits.floor()));
+
+            std::vector<std::size_t> out;
+            std::shared_lock lock(_mutex);
+            const Node* node = _find(key, m);
+            if(node != nullptr)
+            {
+                _collect(node, out);
+            }
+            return out;
+        }
+
+        //! @brief The number of entries y with val(y - x) >= k.
+        std::size_t count(const PadicNumber& x, signed_long_t k) const
+        {
+            const Key key = _key(x);
+            const std::size_t m = static_cast<std::size_t>(std::clamp(k - _digits.floor(), signed_long_t(0), _digits.prec() - _digits.floor()));
+
+            std::shared_lock lock(_mutex);
+            const Node* node = _find(key, m);
+            return node == nullptr ? 0 : node->size;
+        }
+
+        //! @brief The entries closest to x.
+        //! @return The largest k for which the ball around x of radius p^-k is not empty
+        //!         (prec for an exact match), and the ids of all entries in that ball.
+        std::pair<signed_long_t, std::vector<std::size_t>> nearest(const PadicNumber& x) const
+        {
+            const Key key = _key(x);
+            std::vector<std::size_t> out;
+
+            std::shared_lock lock(_mutex);
+            const Node* node = &_root;
+            std::size_t d = 0;
+            while(d < key.size())
+            {
+                const Node* c = _child(node, key[d]);
+                if(c == nullptr)
+                {
+                    break;
+                }
+                std::size_t l = 1;
+                while(l < c->label.size() && c->label[l] == key[d + l])
+                {
+                    l++;
+                }
+                node = c;
+                d += l;
+                if(l < c->label.size())
+                {
+                    break;
+                }
+            }
+            _collect(node, out);
+            return { _digits.floor() + static_cast<signed_long_t>(d), std::move(out) };
+        }
+
+        //! @brief A copy of the entry with the given id.
+        PadicNumber at(std::size_t id) const
+        {
+            std::shared_lock lock(_mutex);
+            return _items.at(id);
+        }
+
+        std::size_t size() const
+        {
+            std::shared_lock lock(_mutex);
+            return _items.size();
+        }
+    };
+
+
+    //! @brief The ultrametric tree of a set of PadicNumbers.
+    //! @details Sorting the digit strings of PadicDigits lexicographically puts every p-adic ball
+    //!          into a contiguous range, and val(x_i - x_j) is floor plus the shortest common
+    //!          prefix between neighbours from position i to position j. The clusters are the
+    //!          Cartesian tree of these neighbour prefixes, built with one stack pass after the
+    //!          O(n log n) sort, and a sparse table answers single valuations in O(1).
+    //!          Valuations are capped at prec.
+    class PadicUltrametricTree
+    {
+    public:
+        struct Cluster
+        {
+            signed_long_t val;                  // the members agree modulo p^val
+            std::size_t begin;                  // members are order()[begin, end)
+            std::size_t end;
+            std::size_t parent;                 // the root is its own parent
+            std::vector<std::size_t> children;  // empty for the leaf of a single element
+        };
+
+    private:
+        PadicDigits _digits;
+        std::vector<std::size_t> _order;        // element ids sorted by key
+        std::vector<std::size_t> _rank;         // position of each element in _order
+        std::vector<std::vector<signed_long_t>> _table; // _table[j][i] = min of the valuations between neighbours i + 1, ..., i + 2^j
+        std::vector<Cluster> _clusters;         // the first n are the leaves, in element order
+        std::size_t _root = 0;
+
+        //! @brief The valuation of the difference of the elements at sorted positions a < b.
+        signed_long_t _val(std::size_t a, std::size_t b) const
+        {
+            const std::size_t n = b - a;
+            const std::size_t j = std::bit_width(n) - 1;
+            return std::min(_table[j][a], _table[j][b - (std::size_t(1) << j)]);
+        }
+
+    public:
+        //! @param prec The precision at which numbers are compared.
+        //! @param floor The smallest valuation of the numbers.
+        PadicUltrametricTree(std::shared_ptr<PadicContext> ctx, std::span<const PadicNumber> xs, signed_long_t prec = PADIC_DEFAULT_PREC, signed_long_t floor = 0, unsigned threads = 0)
+            : _digits(ctx, prec, floor)
+        {
+            const std::size_t n = xs.size();
+            const std::size_t D = _digits.length();
+
+            std::vector<unsigned_long_t> keys(n * D);
+            parallel_for(n, [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    _digits.get(std::span<unsigned_long_t>(keys.data() + i * D, D), xs[i]);
+                }
+            }, threads);
+
+            _order.resize(n);
+            for(std::size_t i = 0; i < n; i++)
+            {
+                _order[i] = i;
+            }
+            std::sort(_order.begin(), _order.end(), [&keys, D](std::size_t a, std::size_t b)
+            {
+                return std::lexicographical_compare(keys.begin() + a * D, keys.begin() + (a + 1) * D, keys.begin() + b * D, keys.begin() + (b + 1) * D);
+            });
+            _rank.resize(n);
+            for(std::size_t i = 0; i < n; i++)
+            {
+                _rank[_order[i]] = i;
+            }
+
+            // valuations between sorted neighbours, h[i] for positions i and i + 1
+            std::vector<signed_long_t> h(n > 0 ? n - 1 : 0);
+            parallel_for(h.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    auto a = keys.begin() + _order[i] * D;
+                    auto b = keys.begin() + _order[i + 1] * D;
+                    h[i] = floor + static_cast<signed_long_t>(std::mismatch(a, a + D, b).first - a);
+                }
+            }, threads);
+
+            _table.push_back(h);
+            for(std::size_t j = 1; (std::size_t(1) << j) <= h.size(); j++)
+            {
+                const auto& prev = _table[j - 1];
+                std::vector<signed_long_t> row(h.size() - (std::size_t(1) << j) + 1);
+                for(std::size_t i = 0; i < row.size(); i++)
+                {
+                    row[i] = std::min(prev[i], prev[i + (std::size_t(1) << (j - 1))]);
+                }
+                _table.push_back(std::move(row));
+            }
+
+            if(n == 0)
+            {
+                return;
+            }
+            _clusters.reserve(2 * n);
+            for(std::size_t i = 0; i < n; i++)
+            {
+                _clusters.push_back({ prec, _rank[i], _rank[i] + 1, i, {} });
+            }
+
+            // stack of open clusters with increasing valuations
+            std::vector<std::size_t> open;
+            std::size_t last = _order[0];
+            for(std::size_t i = 1; i <= n; i++)
+            {
+                const signed_long_t v = i < n ? h[i - 1] : floor - 1;
+                while(!open.empty() && _clusters[open.back()].val > v)
+                {
+                    Cluster& top = _clusters[open.back()];
+                    top.children.push_back(last);
+                    top.end = i;
+                    last = open.back();
+                    open.pop_back();
+                }
+                if(i == n)
+                {
+                    break;
+                }
+                if(!open.empty() && _clusters[open.back()].val == v)
+                {
+                    _clusters[open.back()].children.push_back(last);
+                }
+                else
+                {
+                    _clusters.push_back({ v, _clusters[last].begin, 0, 0, { last } });
+                    open.push_back(_clusters.size() - 1);
+                }
+                last = _order[i];
+            }
+            _root = last;
+
+            for(std::size_t c = 0; c < _clusters.size(); c++)
+            {
+                for(auto child : _clusters[c].children)
+                {
+                    _clusters[child].parent = c;
+                }
+            }
+            _clusters[_root].parent = _root;
+        }
+
+        //! @brief The number of elements.
+        std::size_t size() const
+        {
+            return _order.size();
+        }
+
+        //! @brief The element ids in digit order, every cluster is a contiguous range of it.
+        std::span<const std::size_t> order() const
+        {
+            return _order;
+        }
+
+        std::size_t root() const
+        {
+            return _root;
+        }
+
+        //! @brief The leaf cluster of element i is cluster i.
+        const Cluster& cluster(std::size_t c) const
+        {
+            return _clusters.at(c);
+        }
+
+        std::size_t clusterCount() const
+        {
+            return _clusters.size();
+        }
+
+        //! @brief The element ids in a cluster.
+        std::span<const std::size_t> members(std::size_t c) const
+        {
+            const Cluster& cl = _clusters.at(c);
+            return std::span<const std::size_t>(_order).subspan(cl.begin, cl.end - cl.begin);
+        }
+
+        //! @brief val(x_i - x_j), capped at prec.
+        signed_long_t valuation(std::size_t i, std::size_t j) const
+        {
+            const std::size_t a = std::min(_rank.at(i), _rank.at(j));
+            const std::size_t b = std::max(_rank.at(i), _rank.at(j));
+            return a == b ? _digits.prec() : _val(a, b);
+        }
+
+        //! @brief The balls of radius p^-k, as ranges of order().
+        //! @return The start of every ball, followed by size().
+        std::vector<std::size_t> cut(signed_long_t k) const
+        {
+            std::vector<std::size_t> starts;
+            for(std::size_t i = 0; i < _order.size(); i++)
+            {
+                if(i == 0 || _table[0][i - 1] < k)
+                {
+                    starts.push_back(i);
+                }
+            }
+            starts.push_back(_order.size());
+            return starts;
+        }
+
+        //! @brief The dense block of valuations val(x_i - x_j) for i in rows and j in cols, row-major.
+        std::vector<signed_long_t> block(std::span<const std::size_t> rows, std::span<const std::size_t> cols, unsigned threads = 0) const
+        {
+            std::vector<signed_long_t> out(rows.size() * cols.size());
+            parallel_for(rows.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t r = begin; r < end; r++)
+                {
+                    for(std::size_t c = 0; c < cols.size(); c++)
+                    {
+                        out[r * cols.size() + c] = valuation(rows[r], cols[c]);
+                    }
+                }
+            }, threads);
+            return out;
+        }
+    };
+
+
+    //! @brief Word keys for the digit order of PadicNumbers.
+    //! @details The digit order compares the valuation first, and then the digits of the unit
+    //!          from the least significant one upward, zero sorts last. Numbers with val < floor
+    //!          are rejected. The key is the biased valuation followed by the unit digits in
+    //!          word-size chunks, each chunk with its digits reversed so that the numeric order
+    //!          of the words is the digit order. Comparing keys as word arrays, for example in
+    //!          an external sort, gives the same order as radix_order().
+    class PadicSortKey
+    {
+    private:
+        PadicDigits _digits;
+
+    public:
+        //! @param prec The precision at which numbers are compared.
+        //! @param floor The smallest valuation of the numbers.
+        PadicSortKey(std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC, signed_long_t floor = 0)
+            : _digits(ctx, prec, floor)
+        {
+        }
+
+        //! @brief The number of words in a key.
+        std::size_t length() const
+        {
+            return 1 + (_digits.length() + _digits.chunkDigits() - 1) / _digits.chunkDigits();
+        }
+
+        //! @brief Write the key of x into key, which must hold length() words.
+        void get(std::span<unsigned_long_t> key, const PadicNumber& x) const
+        {
+            std::fill(key.begin(), key.end(), 0);
+            const signed_long_t prec = _digits.prec();
+            if(padic_is_zero(x._val) || padic_val(x._val) >= prec)
+            {
+                key[0] = static_cast<unsigned_long_t>(prec - _digits.floor());
+                return;
+            }
+            const signed_long_t v = padic_val(x._val);
+            if(v < _digits.floor())
+            {
+                throw std::domain_error("The valuation is below the floor of the sort key.");
+            }
+            key[0] = static_cast<unsigned_long_t>(v - _digits.floor());
+
+            const unsigned_long_t p = _digits.base();
+            fmpz_t r, pN;
+            fmpz_init(r);
+            const int alloc = _padic_ctx_pow_ui(pN, prec - v, x._getContext());
+            fmpz_mod(r, padic_unit(x._val), pN);
+            if(alloc)
+            {
+                fmpz_clear(pN);
+            }
+            for(std::size_t i = 1; i < key.size() && !fmpz_is_zero(r); i++)
+            {
+                unsigned_long_t w = fmpz_fdiv_ui(r, _digits.chunk());
+                fmpz_fdiv_q_ui(r, r, _digits.chunk());
+                unsigned_long_t reversed = 0;
+                for(unsigned j = 0; j < _digits.chunkDigits(); j++)
+                {
+                    reversed = reversed * p + w % p;
+                    w /= p;
+                }
+                key[i] = reversed;
+            }
+            fmpz_clear(r);
+        }
+
+        std::vector<unsigned_long_t> operator()(const PadicNumber& x) const
+        {
+            std::vector<unsigned_long_t> key(length());
+            get(key, x);
+            return key;
+        }
+    };
+
+    //! @brief The permutation that sorts xs in digit order, see PadicSortKey.
+    //! @details A stable least significant digit radix sort over the bytes of the key words.
+    //!          Every pass counts bytes per block in parallel, and scatters the blocks in parallel
+    //!          to the offsets from the joint prefix sum. Passes where all elements share the byte
+    //!          are skipped. All numbers must have the same context.
+    //! @param prec The precision at which numbers are compared.
+    //! @return order, such that xs[order[0]], xs[order[1]], ... is sorted.
+    std::vector<std::size_t> radix_order(std::span<const PadicNumber> xs, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned threads = 0)
+    {
+        const std::size_t n = xs.size();
+        std::vector<std::size_t> order(n);
+        for(std::size_t i = 0; i < n; i++)
+        {
+            order[i] = i;
+        }
+        if(n < 2)
+        {
+            return order;
+        }
+
+        signed_long_t floor = prec;
+        for(const auto& x : xs)
+        {
+            if(!padic_is_zero(x._val))
+            {
+                floor = std::min(floor, padic_val(x._val));
+            }
+        }
+        const PadicSortKey sortKey(xs[0].getContext(), prec, std::min(floor, prec - 1));
+        const std::size_t L = sortKey.length();
+
+        if(threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        const std::size_t blocks = std::min<std::size_t>(threads, (n + 1023) / 1024);
+        const std::size_t blockSize = (n + blocks - 1) / blocks;
+
+        std::vector<unsigned_long_t> keys(n * L);
+        parallel_for(n, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                sortKey.get(std::span<unsigned_long_t>(keys.data() + i * L, L), xs[i]);
+            }
+        }, threads);
+
+        constexpr unsigned radix = 256;
+        std::vector<std::size_t> next(n);
+        std::vector<std::size_t> counts(blocks * radix);
+        for(std::size_t w = L; w-- > 0; )
+        {
+            for(unsigned shift = 0; shift < FLINT_BITS; shift += 8)
+            {
+                auto byte = [&](std::size_t id) { return (keys[id * L + w] >> shift) & (radix - 1); };
+
+                std::fill(counts.begin(), counts.end(), 0);
+                parallel_for(blocks, [&](std::size_t begin, std::size_t end)
+                {
+                    for(std::size_t b = begin; b < end; b++)
+                    {
+                        std::size_t* c = counts.data() + b * radix;
+                        for(std::size_t i = b * blockSize; i < std::min(n, (b + 1) * blockSize); i++)
+                        {
+                            c[byte(order[i])]++;
+                        }
+                    }
+                }, threads);
+
+                // offsets in bucket-major, block-minor order keep the pass stable
+                std::size_t total = 0;
+                bool trivial = false;
+                for(unsigned d = 0; d < radix; d++)
+                {
+                    std::size_t bucket = 0;
+                    for(std::size_t b = 0; b < blocks; b++)
+                    {
+                        const std::size_t c = counts[b * radix + d];
+                        counts[b * radix + d] = total + bucket;
+                        bucket += c;
+                    }
+                    trivial = trivial || bucket == n;
+                    total += bucket;
+                }
+                if(trivial)
+                {
+                    continue;
+                }
+
+                parallel_for(blocks, [&](std::size_t begin, std::size_t end)
+                {
+                    for(std::size_t b = begin; b < end; b++)
+                    {
+                        std::size_t* c = counts.data() + b * radix;
+                        for(std::size_t i = b * blockSize; i < std::min(n, (b + 1) * blockSize); i++)
+                        {
+                            next[c[byte(order[i])]++] = order[i];
+                        }
+                    }
+                }, threads);
+                order.swap(next);
+            }
+        }
+        return order;
+    }
+
+    //! @brief Sort xs in digit order, see radix_order().
+    void radix_sort(std::span<PadicNumber> xs, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned threads = 0)
+    {
+        const auto order = radix_order(xs, prec, threads);
+        std::vector<PadicNumber> sorted;
+        sorted.reserve(xs.size());
+        for(auto i : order)
+        {
+            sorted.push_back(std::move(xs[i]));
+        }
+        std::move(sorted.begin(), sorted.end(), xs.begin());
+    }
+
+
+    //! @brief Counter-based generator of Haar-random PadicNumbers.
+    //! @details Uses Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+    //!          The random words of element i are a pure function of the seed, i and the block
+    //!          number, so any range of the stream can be generated on any thread and the result
+    //!          does not depend on the number of threads. The unit is drawn with 64 bits more than
+    //!          p^(N - k), the bias of the final reduction is below 2^-64.
+    class PadicRandom
+    {
+    private:
+        unsigned_long_t _seed;
+
+    public:
+        using Block = std::array<uint32_t, 4>;
+
+        explicit PadicRandom(unsigned_long_t seed) : _seed(seed)
+        {
+        }
+
+        //! @brief One Philox4x32-10 block.
+        static Block philox(Block counter, std::array<uint32_t, 2> key)
+        {
+            for(int round = 0; round < 10; round++)
+            {
+                const uint64_t a = uint64_t(0xD2511F53) * counter[0];
+                const uint64_t b = uint64_t(0xCD9E8D57) * counter[2];
+                counter = { uint32_t(b >> 32) ^ counter[1] ^ key[0], uint32_t(b), uint32_t(a >> 32) ^ counter[3] ^ key[1], uint32_t(a) };
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+            return counter;
+        }
+
+        //! @brief Word j of the stream of element i.
+        uint64_t word(uint64_t i, uint64_t j) const
+        {
+            const Block r = philox({ uint32_t(i), uint32_t(i >> 32), uint32_t(j >> 1), uint32_t(j >> 33) }, { uint32_t(_seed), uint32_t(_seed >> 32) });
+            return (j & 1) ? (uint64_t(r[3]) << 32 | r[2]) : (uint64_t(r[1]) << 32 | r[0]);
+        }
+
+        //! @brief Set x to a uniformly random element of p^k Z_p at its precision.
+        //! @param i The position of x in the stream.
+        void get(PadicNumber& x, signed_long_t k, uint64_t i) const
+        {
+            const padic_ctx_t& ctx = x._getContext();
+            const signed_long_t N = padic_prec(x._val);
+            if(k >= N)
+            {
+                padic_zero(x._val);
+                return;
+            }
+
+            fmpz_t pN;
+            const int alloc = _padic_ctx_pow_ui(pN, N - k, ctx);
+            const uint64_t words = (fmpz_bits(pN) + 63) / 64 + 1;
+
+            fmpz* u = padic_unit(x._val);
+            fmpz_zero(u);
+            for(uint64_t j = 0; j < words; j++)
+            {
+                fmpz_mul_2exp(u, u, 64);
+                fmpz_add_ui(u, u, word(i, j));
+            }
+            fmpz_mod(u, u, pN);
+            if(alloc)
+            {
+                fmpz_clear(pN);
+            }
+            padic_val(x._val) = k;
+            _padic_canonicalise(x._val, ctx);
+        }
+
+        //! @brief Fill xs with independent uniformly random elements of p^k Z_p, each at its own precision.
+        //! @param first The stream position of xs[0], the others follow consecutively.
+        void fill(std::span<PadicNumber> xs, signed_long_t k = 0, uint64_t first = 0, unsigned threads = 0) const
+        {
+            parallel_for(xs.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    get(xs[i], k, first + i);
+                }
+            }, threads);
+        }
+    };
+
+
+    //! @brief Set xs[i] = nums[i]/den for fractions with a common denominator.
+    //! @details The unit part of den is inverted once, every element then costs one
+    //!          multiplication and reduction. All elements must have the same context.
+    void set_batch(std::span<PadicNumber> xs, std::span<const Fmpz> nums, const Fmpz& den)
+    {
+        if(xs.size() != nums.size())
+        {
+            throw std::invalid_argument("The spans must have the same length.");
+        }
+        if(fmpz_is_zero(den.get()))
+        {
+            throw std::domain_error("The denominator is zero.");
+        }
+        std::vector<PadicNumber*> targets(xs.size());
+        std::vector<const fmpz*> values(xs.size());
+        for(std::size_t i = 0; i < xs.size(); i++)
+        {
+            targets[i] = &xs[i];
+            values[i] = nums[i].get();
+        }
+        PadicNumber::_setFractions(targets.data(), values.data(), xs.size(), den.get());
+    }
+
+    //! @brief Set xs[i] = qs[i], inverting each distinct denominator once.
+    //! @details The fractions are grouped by sorting on the denominator. All elements must have the same context.
+    void set_batch(std::span<PadicNumber> xs, std::span<const Fmpq> qs)
+    {
+        if(xs.size() != qs.size())
+        {
+            throw std::invalid_argument("The spans must have the same length.");
+        }
+        // runs of equal denominators after sorting share one inversion
+        std::vector<std::size_t> order(qs.size());
+        for(std::size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&qs](std::size_t a, std::size_t b)
+        {
+            return fmpz_cmp(fmpq_denref(qs[a].get()), fmpq_denref(qs[b].get())) < 0;
+        });
+
+        std::vector<PadicNumber*> targets;
+        std::vector<const fmpz*> values;
+        for(std::size_t begin = 0; begin < order.size(); )
+        {
+            const fmpz* den = fmpq_denref(qs[order[begin]].get());
+            targets.clear();
+            values.clear();
+            std::size_t end = begin;
+            for(; end < order.size() && fmpz_equal(fmpq_denref(qs[order[end]].get()), den); end++)
+            {
+                targets.push_back(&xs[order[end]]);
+                values.push_back(fmpq_numref(qs[order[end]].get()));
+            }
+            PadicNumber::_setFractions(targets.data(), values.data(), targets.size(), den);
+            begin = end;
+        }
+    }
+
+
+    //! @brief The fraction a/b with |a| <= num_bound and 0 < b <= den_bound that x approximates.
+    //! @details x = a·p^-s is known modulo p^(N + s) with s = max(-val(x), 0), and a/b' with b = b'·p^s
+    //!          is recovered from a by the half-gcd based fmpq_reconstruct_fmpz_2. The answer is
+    //!          unique when 2·num_bound·den_bound < p^N.
+    //! @return The fraction, or nothing if there is none within the bounds.
+    std::optional<Fmpq> to_rational(const PadicNumber& x, const Fmpz& num_bound, const Fmpz& den_bound)
+    {
+        if(fmpz_sgn(num_bound.get()) < 0 || fmpz_sgn(den_bound.get()) <= 0)
+        {
+            throw std::invalid_argument("The numerator bound must be non-negative and the denominator bound positive.");
+        }
+        Fmpq q;
+        if(padic_is_zero(x._val))
+        {
+            return q;
+        }
+
+        const padic_ctx_t& ctx = x._getContext();
+        const signed_long_t v = padic_val(x._val);
+        const signed_long_t s = std::max(-v, signed_long_t(0));
+
+        fmpz_t m, a, D, ps;
+        fmpz_init(a);
+        fmpz_init(D);
+        fmpz_init(ps);
+        const int alloc = _padic_ctx_pow_ui(m, padic_prec(x._val) + s, ctx);
+        fmpz_pow_ui(ps, ctx->p, v + s);
+        fmpz_mul(a, padic_unit(x._val), ps);
+        fmpz_mod(a, a, m);
+        fmpz_pow_ui(ps, ctx->p, s);
+        fmpz_fdiv_q(D, den_bound.get(), ps);
+
+        const bool found = !fmpz_is_zero(D) && fmpq_reconstruct_fmpz_2(q.get(), a, m, num_bound.get(), D);
+        if(found && s > 0)
+        {
+            fmpz_mul(fmpq_denref(q.get()), fmpq_denref(q.get()), ps);
+            fmpq_canonicalise(q.get());
+        }
+
+        if(alloc)
+        {
+            fmpz_clear(m);
+        }
+        fmpz_clear(a);
+        fmpz_clear(D);
+        fmpz_clear(ps);
+        if(!found)
+        {
+            return std::nullopt;
+        }
+        return q;
+    }
+
+    //! @brief to_rational() with the balanced bounds num_bound = den_bound = floor(sqrt((p^(N + s) - 1)/2)).
+    //! @details Subtracting one keeps 2·num_bound·den_bound < p^(N + s) strict for p = 2.
+    std::optional<Fmpq> to_rational(const PadicNumber& x)
+    {
+        Fmpz bound;
+        fmpz_pow_ui(bound.get(), x._getContext()->p, padic_prec(x._val) + std::max(-padic_val(x._val), signed_long_t(0)));
+        fmpz_sub_ui(bound.get(), bound.get(), 1);
+        fmpz_fdiv_q_2exp(bound.get(), bound.get(), 1);
+        fmpz_sqrt(bound.get(), bound.get());
+        return to_rational(x, bound, bound);
+    }
+
+    //! @brief to_rational() for every element of xs, in parallel.
+    std::vector<std::optional<Fmpq>> to_rational(std::span<const PadicNumber> xs, const Fmpz& num_bound, const Fmpz& den_bound, unsigned threads = 0)
+    {
+        std::vector<std::optional<Fmpq>> result(xs.size());
+        parallel_for(xs.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                result[i] = to_rational(xs[i], num_bound, den_bound);
+            }
+        }, threads);
+        return result;
+    }
+
+
+    //! @brief The eventually periodic base-p expansion of a rational number.
+    //! @details Write q = p^v·c/d with p coprime to c and d > 0. The digits of c/d follow the
+    //!          numerator recurrence c -> (c - δ·d)/p with δ = c/d mod p, which shrinks c into
+    //!          [-d, 0] after about log_p(|c|/d) steps. c/d is purely periodic exactly when c lies
+    //!          in that range, and the period is the multiplicative order of p modulo d. Only
+    //!          integers of the size of c and d are involved, never p^N. p must fit into a word.
+    class PadicExpansion
+    {
+    private:
+        signed_long_t _val = 0;
+        std::vector<unsigned_long_t> _preperiod;
+        std::vector<unsigned_long_t> _period;
+
+    public:
+        //! @param maxPeriod The longest period to compute, longer ones throw std::overflow_error.
+        PadicExpansion(std::shared_ptr<PadicContext> ctx, const Fmpq& q, std::size_t maxPeriod = std::size_t(1) << 24)
+        {
+            const fmpz* P = ctx->get()->p;
+            if(!fmpz_abs_fits_ui(P))
+            {
+                throw std::invalid_argument("The prime must fit into a word.");
+            }
+            const unsigned_long_t p = fmpz_get_ui(P);
+            if(fmpq_is_zero(q.get()))
+            {
+                _period.push_back(0);
+                return;
+            }
+
+            fmpz_t c, d, start;
+            fmpz_init(c);
+            fmpz_init(d);
+            fmpz_init(start);
+            _val = fmpz_remove(c, fmpq_numref(q.get()), P) - fmpz_remove(d, fmpq_denref(q.get()), P);
+            const unsigned_long_t dinv = n_invmod(fmpz_fdiv_ui(d, p), p);
+
+            auto step = [&]()
+            {
+                const unsigned_long_t digit = n_mulmod2_preinv(fmpz_fdiv_ui(c, p), dinv, p, n_preinvert_limb(p));
+                fmpz_submul_ui(c, d, digit);
+                fmpz_divexact_ui(c, c, p);
+                return digit;
+            };
+
+            // preperiod, until -d <= c <= 0
+            while(fmpz_sgn(c) > 0 || fmpz_cmpabs(c, d) > 0)
+            {
+                _preperiod.push_back(step());
+            }
+            fmpz_set(start, c);
+            do
+            {
+                if(_period.size() == maxPeriod)
+                {
+                    fmpz_clear(c);
+                    fmpz_clear(d);
+                    fmpz_clear(start);
+                    throw std::overflow_error("The period is longer than maxPeriod.");
+                }
+                _period.push_back(step());
+            }
+            while(!fmpz_equal(c, start));
+
+            fmpz_clear(c);
+            fmpz_clear(d);
+            fmpz_clear(start);
+        }
+
+        //! @brief The valuation of q, the expansion starts at p^val, 0 for q = 0.
+        signed_long_t val() const
+        {
+            return _val;
+        }
+
+        //! @brief The digits of p^val, ..., p^(val + L - 1) before the period starts.
+        const std::vector<unsigned_long_t>& preperiod() const
+        {
+            return _preperiod;
+        }
+
+        //! @brief The repeating digits, never empty.
+        const std::vector<unsigned_long_t>& period() const
+        {
+            return _period;
+        }
+
+        //! @brief The coefficient of p^i in q.
+        unsigned_long_t digit(signed_long_t i) const
+        {
+            if(i < _val)
+            {
+                return 0;
+            }
+            const std::size_t k = static_cast<std::size_t>(i - _val);
+            return k < _preperiod.size() ? _preperiod[k] : _period[(k - _preperiod.size()) % _period.size()];
+        }
+
+        //! @brief The coefficient of p^i in q, for arbitrarily large i in O(log i).
+        unsigned_long_t digit(const Fmpz& i) const
+        {
+            if(fmpz_fits_si(i.get()))
+            {
+                return digit(fmpz_get_si(i.get()));
+            }
+            if(fmpz_sgn(i.get()) < 0)
+            {
+                return 0;
+            }
+            fmpz_t k;
+            fmpz_init(k);
+            fmpz_sub_si(k, i.get(), _val + static_cast<signed_long_t>(_preperiod.size()));
+            const unsigned_long_t r = fmpz_fdiv_ui(k, _period.size());
+            fmpz_clear(k);
+            return _period[r];
+        }
+    };
+
+
+    //! @brief The multiplicative order of the unit x in (Z/p^N)^*, N = prec(x).
+    //! @details With m the order of x modulo p, y = x^m is a principal unit and its order is
+    //!          p^max(N - val(y - 1), 0). For p = 2 units that are 3 mod 4 are squared first,
+    //!          as only 1 + 4Z_2 is torsion free.
+    Fmpz order(const PadicNumber& x)
+    {
+        if(padic_is_zero(x._val) || padic_val(x._val) != 0)
+        {
+            throw std::domain_error("The order is only defined for units.");
+        }
+        const auto ctx = x.getContext();
+        const fmpz* p = ctx->get()->p;
+        const signed_long_t N = padic_prec(x._val);
+
+        Fmpz u;
+        fmpz_set(u.get(), padic_unit(x._val));
+        Fmpz m = ctx->order(u);
+        if(N <= 1)
+        {
+            return m;
+        }
+
+        fmpz_t pN, y, e;
+        fmpz_init(y);
+        fmpz_init(e);
+        const int alloc = _padic_ctx_pow_ui(pN, N, ctx->get());
+        fmpz_powm(y, padic_unit(x._val), m.get(), pN);
+        if(fmpz_equal_ui(p, 2) && fmpz_fdiv_ui(y, 4) == 3)
+        {
+            fmpz_mul_ui(m.get(), m.get(), 2);
+            fmpz_powm_ui(y, y, 2, pN);
+        }
+        fmpz_sub_ui(y, y, 1);
+        const signed_long_t w = fmpz_is_zero(y) ? N : std::min(N, static_cast<signed_long_t>(fmpz_remove(e, y, p)));
+        fmpz_pow_ui(e, p, N - w);
+        fmpz_mul(m.get(), m.get(), e);
+
+        if(alloc)
+        {
+            fmpz_clear(pN);
+        }
+        fmpz_clear(y);
+        fmpz_clear(e);
+        return m;
+    }
+
+    //! @brief True if x generates (Z/p^N)^*, N = prec(x), that is its order is (p - 1)·p^(N - 1).
+    bool is_primitive(const PadicNumber& x)
+    {
+        if(padic_is_zero(x._val) || padic_val(x._val) != 0)
+        {
+            return false;
+        }
+        const fmpz* p = x._getContext()->p;
+        Fmpz phi, q;
+        fmpz_pow_ui(q.get(), p, padic_prec(x._val) - 1);
+        fmpz_mul(phi.get(), q.get(), p);
+        fmpz_sub(phi.get(), phi.get(), q.get());
+        return order(x) == phi;
+    }
+
+
+    //! @brief The Teichmüller representative ω(x), the (p - 1)-th root of unity congruent to x mod p.
+    //! @details Read from the context table when it reaches prec, otherwise lifted with
+    //!          padic_teichmuller. ω(x) = 0 for val(x) > 0.
+    PadicNumber teichmuller(const PadicNumber& x, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        if(!padic_is_zero(x._val) && padic_val(x._val) < 0)
+        {
+            throw std::domain_error("The Teichmüller lift is only defined for p-adic integers.");
+        }
+        PadicNumber y(x.getContext(), prec);
+        if(padic_is_zero(x._val) || padic_val(x._val) > 0 || prec <= 0)
+        {
+            return y;
+        }
+        if(x.getContext()->lookupTeichmuller(padic_unit(y._val), padic_unit(x._val), prec))
+        {
+            padic_val(y._val) = 0;
+        }
+        else
+        {
+            padic_teichmuller(y._val, x._val, x._getContext());
+        }
+        return y;
+    }
+
+    //! @brief The principal unit <x> = x / (p^val(x)·ω(x)), so that x = p^val(x)·ω(x)·<x> and <x> = 1 mod p.
+    PadicNumber principal_unit(const PadicNumber& x, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        if(padic_is_zero(x._val))
+        {
+            throw std::domain_error("Zero has no unit decomposition.");
+        }
+        PadicNumber y(x.getContext(), prec);
+        if(prec <= 0)
+        {
+            return y;
+        }
+        const padic_ctx_t& ctx = x._getContext();
+
+        fmpz_t pN;
+        const int alloc = _padic_ctx_pow_ui(pN, prec, ctx);
+        fmpz* w = padic_unit(y._val);
+        if(!x.getContext()->lookupTeichmuller(w, padic_unit(x._val), prec))
+        {
+            padic_t u;
+            padic_init2(u, prec);
+            fmpz_set(padic_unit(u), padic_unit(x._val));
+            padic_val(u) = 0;
+            padic_teichmuller(y._val, u, ctx);
+            padic_clear(u);
+        }
+        fmpz_invmod(w, w, pN);
+        fmpz_mul(w, w, padic_unit(x._val));
+        fmpz_mod(w, w, pN);
+        padic_val(y._val) = 0;
+        if(alloc)
+        {
+            fmpz_clear(pN);
+        }
+        return y;
+    }
+
+    //! @brief The (p - 1)-th roots of unity ω(g)^k for k = 0, ..., p - 2, where g is the primitive root of the context.
+    //! @details Entry k is the root whose discrete logarithm to the base ω(g) is k.
+    std::vector<PadicNumber> roots_of_unity(std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        if(!fmpz_abs_fits_ui(ctx->get()->p))
+        {
+            throw std::invalid_argument("The prime must fit into a word.");
+        }
+        const unsigned_long_t p = fmpz_get_ui(ctx->get()->p);
+
+        PadicNumber g(ctx, prec);
+        padic_set_fmpz(g._val, ctx->primitiveRoot().get(), ctx->get());
+        const PadicNumber w = teichmuller(g, prec);
+
+        std::vector<PadicNumber> roots;
+        roots.reserve(p - 1);
+        PadicNumber power(ctx, prec);
+        power.set(static_cast<unsigned_long_t>(1));
+        for(unsigned_long_t k = 0; k + 1 < p; k++)
+        {
+            roots.push_back(power);
+            padic_mul(power._val, power._val, w._val, ctx->get());
+        }
+        return roots;
+    }
+
+
+    //! @brief n-th roots modulo a word-size prime p.
+    //! @details With g = gcd(n, p - 1) the g-th root is taken one prime q | g at a time by the
+    //!          Adleman–Manders–Miller generalisation of Tonelli–Shanks (plain Tonelli–Shanks for
+    //!          q = 2), then raised to (n/g)^-1 mod (p - 1)/g. The Sylow decompositions and
+    //!          non-residues depend only on p and n, batches build them once.
+    struct _ResidueRoots
+    {
+        struct Prime
+        {
+            unsigned_long_t q;
+            unsigned_long_t e;      // q^e || g
+            unsigned_long_t s;      // p - 1 = q^s·t
+            unsigned_long_t t;
+            unsigned_long_t alpha;  // q·alpha = 1 mod t
+            unsigned_long_t z;      // generator of the Sylow q-subgroup
+            unsigned_long_t omega;  // primitive q-th root of unity
+        };
+
+        unsigned_long_t p;
+        unsigned_long_t pinv;
+        unsigned_long_t g = 1;
+        unsigned_long_t c = 1;      // (n/g)^-1 mod (p - 1)/g
+        std::vector<Prime> primes;
+
+        _ResidueRoots(unsigned_long_t p, unsigned_long_t n) : p(p), pinv(n_preinvert_limb(p))
+        {
+            if(p == 2)
+            {
+                return;
+            }
+            g = n_gcd(n, p - 1);
+            const unsigned_long_t m = (p - 1) / g;
+            c = m == 1 ? 1 : n_invmod((n / g) % m, m);
+
+            n_factor_t fac;
+            n_factor_init(&fac);
+            n_factor(&fac, g, 1);
+            for(int i = 0; i < fac.num; i++)
+            {
+                Prime P{ fac.p[i], static_cast<unsigned_long_t>(fac.exp[i]), 0, p - 1, 0, 0, 0 };
+                while(P.t % P.q == 0)
+                {
+                    P.t /= P.q;
+                    P.s++;
+                }
+                P.alpha = P.t == 1 ? 0 : n_invmod(P.q % P.t, P.t);
+                unsigned_long_t rho = 2;
+                while(pow(rho, (p - 1) / P.q) == 1)
+                {
+                    rho++;
+                }
+                P.z = pow(rho, P.t);
+                P.omega = P.z;
+                for(unsigned_long_t j = 1; j < P.s; j++)
+                {
+                    P.omega = pow(P.omega, P.q);
+                }
+                primes.push_back(P);
+            }
+        }
+
+        unsigned_long_t pow(unsigned_long_t a, unsigned_long_t e) const
+        {
+            return n_powmod2_ui_preinv(a, e, p, pinv);
+        }
+
+        unsigned_long_t mul(unsigned_long_t a, unsigned_long_t b) const
+        {
+            return n_mulmod2_preinv(a, b, p, pinv);
+        }
+
+        //! @brief True if a is a k-th power, for k | p - 1. Squares use the Legendre symbol.
+        bool isPower(unsigned_long_t a, unsigned_long_t k) const
+        {
+            if(k == 2 && p <= static_cast<unsigned_long_t>(WORD_MAX))
+            {
+                return n_jacobi(static_cast<signed_long_t>(a), p) == 1;
+            }
+            return pow(a, (p - 1) / k) == 1;
+        }
+
+        //! @brief r^q = a for a q-th power a != 0.
+        //! @details r = a^alpha is a root up to the error r^q/a in the Sylow subgroup, every round
+        //!          lowers the order of the error by multiplying r with a power of z. The logarithm
+        //!          in the subgroup of order q is found by search.
+        unsigned_long_t qthRoot(unsigned_long_t a, const Prime& P) const
+        {
+            unsigned_long_t r = pow(a, P.alpha);
+            unsigned_long_t err = mul(pow(r, P.q), n_invmod(a, p));
+            while(err != 1)
+            {
+                unsigned_long_t m = 0;
+                for(unsigned_long_t e = err; e != 1; e = pow(e, P.q))
+                {
+                    m++;
+                }
+                unsigned_long_t cm = P.z;
+                for(unsigned_long_t j = m + 1; j < P.s; j++)
+                {
+                    cm = pow(cm, P.q);
+                }
+                unsigned_long_t d = err;
+                for(unsigned_long_t j = 1; j < m; j++)
+                {
+                    d = pow(d, P.q);
+                }
+                unsigned_long_t e = 0;
+                for(unsigned_long_t w = 1; w != d; w = mul(w, P.omega))
+                {
+                    e++;
+                }
+                const unsigned_long_t j = (P.q - e) % P.q;
+                r = mul(r, pow(cm, j));
+                err = mul(err, pow(cm, j * P.q));
+            }
+            return r;
+        }
+
+        //! @brief Set r to an n-th root of the unit a.
+        //! @return False if a is not an n-th power.
+        bool root(unsigned_long_t& r, unsigned_long_t a) const
+        {
+            if(p == 2)
+            {
+                r = a;
+                return true;
+            }
+            if(g > 1 && !isPower(a, g))
+            {
+                return false;
+            }
+            unsigned_long_t y = a;
+            unsigned_long_t remaining = g;
+            for(const auto& P : primes)
+            {
+                for(unsigned_long_t i = 0; i < P.e; i++)
+                {
+                    // of the q roots at least one is still a (remaining/q)-th power
+                    y = qthRoot(y, P);
+                    remaining /= P.q;
+                    for(unsigned_long_t j = 0; remaining > 1 && j < P.q && !isPower(y, remaining); j++)
+                    {
+                        y = mul(y, P.omega);
+                    }
+                }
+            }
+            r = pow(y, c);
+            return true;
+        }
+    };
+
+    //! @brief Set r to the m-th root of the unit u modulo p^M congruent to r0 mod p, for p ∤ m.
+    //! @details Newton iteration s <- s + s·(1 - u·s^m)/m for s = u^(-1/m) with precision doubling,
+    //!          then r = u·s^(m - 1), so no inversion is needed after the first digit.
+    void _liftRoot(fmpz_t r, const fmpz_t u, unsigned_long_t r0, unsigned_long_t m, signed_long_t M, const padic_ctx_t ctx)
+    {
+        std::vector<signed_long_t> precs{ M };
+        while(precs.back() > 1)
+        {
+            precs.push_back((precs.back() + 1) / 2);
+        }
+
+        fmpz_t s, e, pk, minv;
+        fmpz_init(s);
+        fmpz_init(e);
+        fmpz_init(pk);
+        fmpz_init(minv);
+        fmpz_pow_ui(pk, ctx->p, M);
+        fmpz_set_ui(minv, m);
+        fmpz_invmod(minv, minv, pk);
+        fmpz_set_ui(s, r0);
+        fmpz_invmod(s, s, ctx->p);
+
+        for(std::size_t i = precs.size() - 1; i-- > 0; )
+        {
+            fmpz_pow_ui(pk, ctx->p, precs[i]);
+            fmpz_powm_ui(e, s, m, pk);
+            fmpz_mul(e, e, u);
+            fmpz_sub_ui(e, e, 1);
+            fmpz_neg(e, e);
+            fmpz_mul(e, e, s);
+            fmpz_mul(e, e, minv);
+            fmpz_add(s, s, e);
+            fmpz_mod(s, s, pk);
+        }
+        fmpz_pow_ui(pk, ctx->p, M);
+        fmpz_powm_ui(r, s, m - 1, pk);
+        fmpz_mul(r, r, u);
+        fmpz_mod(r, r, pk);
+
+        fmpz_clear(s);
+        fmpz_clear(e);
+        fmpz_clear(pk);
+        fmpz_clear(minv);
+    }
+
+    //! @brief Set r to the square root of the odd u modulo 2^L with r = 1 mod 4.
+    //! @details The same Newton iteration for u^(-1/2), run modulo 2^(L + 1) as halving the
+    //!          correction costs a bit. Odd squares are exactly the units that are 1 mod 8.
+    //! @return False if u is not a square.
+    bool _sqrtTwoAdic(fmpz_t r, const fmpz_t u, signed_long_t L)
+    {
+        if(fmpz_fdiv_ui(u, 8) != 1)
+        {
+            return false;
+        }
+        fmpz_t s, e, m1, m2;
+        fmpz_init(e);
+        fmpz_init(m1);
+        fmpz_init(m2);
+        fmpz_init_set_ui(s, 1);
+        fmpz_one(m1);
+        fmpz_mul_2exp(m1, m1, L + 1);
+        fmpz_mul_2exp(m2, m1, 1);
+        while(true)
+        {
+            fmpz_mul(e, s, s);
+            fmpz_mul(e, e, u);
+            fmpz_sub_ui(e, e, 1);
+            fmpz_neg(e, e);
+            fmpz_mod(e, e, m2);
+            if(fmpz_divisible(e, m1))
+            {
+                break;
+            }
+            fmpz_fdiv_q_2exp(e, e, 1);
+            fmpz_addmul(s, s, e);
+            fmpz_mod(s, s, m1);
+        }
+        fmpz_fdiv_q_2exp(m1, m1, 1);
+        fmpz_mul(r, u, s);
+        fmpz_mod(r, r, m1);
+        if(L >= 2 && fmpz_fdiv_ui(r, 4) == 3)
+        {
+            fmpz_sub(r, m1, r);
+        }
+        fmpz_clear(s);
+        fmpz_clear(e);
+        fmpz_clear(m1);
+        fmpz_clear(m2);
+        return true;
+    }
+
+    //! @brief An n-th root of x, or nothing if x is not an n-th power.
+    //! @details x = p^v·u with n | v. For n = p^k·m the m-th root of u comes from the residue field
+    //!          and Newton lifting, computed with k extra digits. The p^k-th root of a unit y is
+    //!          ω(y)^(p^-k mod p - 1)·exp(log<y>/p^k) for odd p, which exists iff val(log<y>) > k,
+    //!          and k square roots chosen 1 mod 4 for p = 2.
+    //! @param roots The residue root tables for p and m, built here when null.
+    std::optional<PadicNumber> _nthRoot(const PadicNumber& x, unsigned_long_t n, signed_long_t prec, const _ResidueRoots* roots)
+    {
+        if(n == 0)
+        {
+            throw std::invalid_argument("The degree of the root must be positive.");
+        }
+        const auto ctx = x.getContext();
+        const padic_ctx_t& c = ctx->get();
+        PadicNumber y(ctx, prec);
+        if(padic_is_zero(x._val))
+        {
+            return y;
+        }
+        const signed_long_t v = padic_val(x._val);
+        if(v % static_cast<signed_long_t>(n) != 0)
+        {
+            return std::nullopt;
+        }
+        const signed_long_t w = v / static_cast<signed_long_t>(n);
+        const signed_long_t M = prec - w;
+
+        if(!fmpz_abs_fits_ui(c->p))
+        {
+            if(n != 2)
+            {
+                throw std::invalid_argument("Roots other than square roots need a prime that fits into a word.");
+            }
+            if(!padic_sqrt(y._val, x._val, c))
+            {
+                return std::nullopt;
+            }
+            return y;
+        }
+        const unsigned_long_t p = fmpz_get_ui(c->p);
+        unsigned_long_t m = n;
+        signed_long_t k = 0;
+        while(m % p == 0)
+        {
+            m /= p;
+            k++;
+        }
+        if(M <= 0)
+        {
+            return y;
+        }
+
+        // m-th root with k extra digits
+        const signed_long_t Mw = M + k;
+        Fmpz r;
+        if(m == 1)
+        {
+            fmpz_set(r.get(), padic_unit(x._val));
+        }
+        else
+        {
+            std::optional<_ResidueRoots> local;
+            if(roots == nullptr)
+            {
+                roots = &local.emplace(p, m);
+            }
+            unsigned_long_t r0;
+            if(!roots->root(r0, fmpz_fdiv_ui(padic_unit(x._val), p)))
+            {
+                return std::nullopt;
+            }
+            _liftRoot(r.get(), padic_unit(x._val), r0, m, Mw, c);
+        }
+
+        if(k > 0 && p == 2)
+        {
+            for(signed_long_t i = 1; i <= k; i++)
+            {
+                if(!_sqrtTwoAdic(r.get(), r.get(), Mw - i))
+                {
+                    return std::nullopt;
+                }
+            }
+        }
+        else if(k > 0)
+        {
+            PadicNumber u(ctx, Mw);
+            fmpz_set(padic_unit(u._val), r.get());
+            _padic_reduce(u._val, c);
+
+            const PadicNumber L = log(principal_unit(u, Mw), Mw);
+            if(!padic_is_zero(L._val) && padic_val(L._val) <= k)
+            {
+                return std::nullopt;
+            }
+            Fmpz e, pk;
+            fmpz_pow_ui(pk.get(), c->p, k);
+            fmpz_sub_ui(e.get(), c->p, 1);
+            fmpz_invmod(e.get(), pk.get(), e.get());
+            PadicNumber root = pow(teichmuller(u, M), e, M);
+            if(!padic_is_zero(L._val))
+            {
+                const PadicNumber z = exp(L >> k, M);
+                padic_mul(root._val, root._val, z._val, c);
+            }
+            fmpz_set(r.get(), padic_unit(root._val));
+        }
+
+        fmpz_t pM;
+        const int alloc = _padic_ctx_pow_ui(pM, M, c);
+        fmpz_mod(padic_unit(y._val), r.get(), pM);
+        padic_val(y._val) = w;
+        if(alloc)
+        {
+            fmpz_clear(pM);
+        }
+        return y;
+    }
+
+    //! @brief A square root of x.
+    //! @details The residue is checked with the Legendre symbol and rooted by Tonelli–Shanks, then
+    //!          lifted by Newton iteration. For p = 2 the root that is 1 mod 4 is returned.
+    //! @throws std::domain_error if x is not a square.
+    PadicNumber sqrt(const PadicNumber& x, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        auto y = _nthRoot(x, 2, prec, nullptr);
+        if(!y)
+        {
+            throw std::domain_error("The number is not a square.");
+        }
+        return std::move(*y);
+    }
+
+    //! @brief An n-th root of x, see sqrt().
+    //! @throws std::domain_error if x is not an n-th power.
+    PadicNumber nth_root(const PadicNumber& x, unsigned_long_t n, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        auto y = _nthRoot(x, n, prec, nullptr);
+        if(!y)
+        {
+            throw std::domain_error("The number is not an n-th power.");
+        }
+        return std::move(*y);
+    }
+
+    //! @brief n-th roots of all xs in parallel, nothing for the elements that are no n-th powers.
+    //! @details The residue field tables are built once for the batch. All elements must have the same context.
+    std::vector<std::optional<PadicNumber>> nth_root(std::span<const PadicNumber> xs, unsigned_long_t n, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned threads = 0)
+    {
+        std::vector<std::optional<PadicNumber>> result(xs.size());
+        if(xs.empty())
+        {
+            return result;
+        }
+        std::optional<_ResidueRoots> roots;
+        const fmpz* P = xs[0].getContext()->get()->p;
+        if(fmpz_abs_fits_ui(P) && n > 0)
+        {
+            const unsigned_long_t p = fmpz_get_ui(P);
+            unsigned_long_t m = n;
+            while(m % p == 0)
+            {
+                m /= p;
+            }
+            roots.emplace(p, m);
+        }
+        parallel_for(xs.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                result[i] = _nthRoot(xs[i], n, prec, roots ? &*roots : nullptr);
+            }
+        }, threads);
+        return result;
+    }
+
+    //! @brief Square roots of all xs in parallel, see nth_root().
+    std::vector<std::optional<PadicNumber>> sqrt(std::span<const PadicNumber> xs, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned threads = 0)
+    {
+        return nth_root(xs, 2, prec, threads);
+    }
+
+
+    //! @brief Discrete logarithms to a fixed base g in (Z/p^N)^*, N = prec(g).
+    //! @details (Z/p^N)^* splits into the residue field part and the principal units. The residue
+    //!          part is solved by Pohlig–Hellman over the cached factorisation of p - 1, with a
+    //!          baby-step giant-step table for each prime. For the principal units log is an
+    //!          isomorphism onto pZ_p (4Z_2 after removing the sign for p = 2), so k = log<h>/log<g>
+    //!          there. The two congruences are combined by CRT. All tables depend on g only and
+    //!          are built once, p must fit into a word.
+    class PadicDlog
+    {
+    private:
+        struct Component
+        {
+            unsigned_long_t q;
+            unsigned_long_t e;
+            unsigned_long_t qe;         // q^e, the q-part of the order of g mod p
+            unsigned_long_t gq;         // g^(m/q^e), of order q^e
+            unsigned_long_t giant;      // γ^-s for γ = g^(m/q) of order q
+            unsigned_long_t s;          // baby steps
+            std::unordered_map<unsigned_long_t, unsigned_long_t> baby;  // γ^j -> j for j < s
+        };
+
+        std::shared_ptr<PadicContext> _ctx;
+        signed_long_t _prec;
+        unsigned_long_t _p;
+        unsigned_long_t _pinv;
+        unsigned_long_t _m = 1;         // order of g mod p
+        std::vector<Component> _components;
+        bool _negative = false;         // p = 2 and g = 3 mod 4
+        signed_long_t _a = 0;           // the principal part fixes k mod p^_a
+        signed_long_t _lgVal = 0;       // log of the principal part of g is p^_lgVal·unit
+        Fmpz _lgInv;                    // unit^-1 mod p^_a
+        Fmpz _order;
+
+        unsigned_long_t _pow(unsigned_long_t a, unsigned_long_t e) const
+        {
+            return n_powmod2_ui_preinv(a, e, _p, _pinv);
+        }
+
+        unsigned_long_t _mul(unsigned_long_t a, unsigned_long_t b) const
+        {
+            return n_mulmod2_preinv(a, b, _p, _pinv);
+        }
+
+        //! @brief The principal part of a unit x at precision N, <x> for odd p and ±x ∈ 1 + 4Z_2 for p = 2.
+        PadicNumber _principal(const PadicNumber& x) const
+        {
+            if(_p != 2)
+            {
+                return principal_unit(x, _prec);
+            }
+            PadicNumber y(_ctx, _prec);
+            padic_set(y._val, x._val, _ctx->get());
+            if(fmpz_fdiv_ui(padic_unit(y._val), 4) == 3)
+            {
+                padic_neg(y._val, y._val, _ctx->get());
+            }
+            return y;
+        }
+
+        //! @brief log_γ t in a component by baby-step giant-step.
+        std::optional<unsigned_long_t> _bsgs(const Component& C, unsigned_long_t t) const
+        {
+            for(unsigned_long_t i = 0; i <= C.q / C.s; i++)
+            {
+                auto it = C.baby.find(t);
+                if(it != C.baby.end())
+                {
+                    return i * C.s + it->second;
+                }
+                t = _mul(t, C.giant);
+            }
+            return std::nullopt;
+        }
+
+        //! @brief k mod q^e with g^k = h mod p, by Pohlig–Hellman digit by digit.
+        std::optional<unsigned_long_t> _component(const Component& C, unsigned_long_t h) const
+        {
+            const unsigned_long_t hq = _pow(h, _m / C.qe);
+            const unsigned_long_t ginv = n_invmod(C.gq, _p);
+            unsigned_long_t k = 0;
+            unsigned_long_t qi = 1;
+            for(unsigned_long_t i = 0; i < C.e; i++)
+            {
+                unsigned_long_t t = _mul(hq, _pow(ginv, k));
+                for(unsigned_long_t j = i + 1; j < C.e; j++)
+                {
+                    t = _pow(t, C.q);
+                }
+                const auto d = _bsgs(C, t);
+                if(!d)
+                {
+                    return std::nullopt;
+                }
+                k += *d * qi;
+                qi *= C.q;
+            }
+            return k;
+        }
+
+    public:
+        //! @param g A unit, its precision is the precision N of the logarithms.
+        explicit PadicDlog(const PadicNumber& g) : _ctx(g.getContext()), _prec(padic_prec(g._val))
+        {
+            if(padic_is_zero(g._val) || padic_val(g._val) != 0)
+            {
+                throw std::domain_error("The base must be a unit.");
+            }
+            if(!fmpz_abs_fits_ui(_ctx->get()->p))
+            {
+                throw std::invalid_argument("The prime must fit into a word.");
+            }
+            _p = fmpz_get_ui(_ctx->get()->p);
+            _pinv = n_preinvert_limb(_p);
+
+            // residue field part
+            const unsigned_long_t g0 = fmpz_fdiv_ui(padic_unit(g._val), _p);
+            Fmpz g0z;
+            g0z.set(g0);
+            _m = fmpz_get_ui(_ctx->order(g0z).get());
+            unsigned_long_t m = _m;
+            for(const auto& [Q, exponent] : _ctx->unitGroupFactors())
+            {
+                const unsigned_long_t q = fmpz_get_ui(Q.get());
+                Component C{ q, 0, 1, 0, 0, 0, {} };
+                while(m % q == 0)
+                {
+                    m /= q;
+                    C.e++;
+                    C.qe *= q;
+                }
+                if(C.e == 0)
+                {
+                    continue;
+                }
+                C.gq = _pow(g0, _m / C.qe);
+                const unsigned_long_t gamma = _pow(g0, _m / q);
+                C.s = n_sqrt(q - 1) + 1;
+                C.baby.reserve(C.s);
+                unsigned_long_t b = 1;
+                for(unsigned_long_t j = 0; j < C.s; j++)
+                {
+                    C.baby.emplace(b, j);
+                    b = _mul(b, gamma);
+                }
+                C.giant = n_invmod(b, _p);
+                _components.push_back(std::move(C));
+            }
+
+            // principal part
+            _negative = _p == 2 && fmpz_fdiv_ui(padic_unit(g._val), 4) == 3;
+            const PadicNumber L = log(_principal(g), _prec);
+            if(!padic_is_zero(L._val))
+            {
+                _lgVal = padic_val(L._val);
+                _a = _prec - _lgVal;
+                fmpz_t pa;
+                const int alloc = _padic_ctx_pow_ui(pa, _a, _ctx->get());
+                fmpz_invmod(_lgInv.get(), padic_unit(L._val), pa);
+                if(alloc)
+                {
+                    fmpz_clear(pa);
+                }
+            }
+
+            fmpz_pow_ui(_order.get(), _ctx->get()->p, _a);
+            if(_p == 2)
+            {
+                if(_negative && _a == 0)
+                {
+                    _order.set(static_cast<unsigned_long_t>(2));
+                }
+            }
+            else
+            {
+                fmpz_mul_ui(_order.get(), _order.get(), _m);
+            }
+        }
+
+        //! @brief The order of g in (Z/p^N)^*, logarithms are reduced modulo it.
+        const Fmpz& order() const
+        {
+            return _order;
+        }
+
+        //! @brief The k in [0, order()) with g^k = h mod p^N, or nothing if h is not a power of g.
+        std::optional<Fmpz> operator()(const PadicNumber& h) const
+        {
+            if(padic_is_zero(h._val) || padic_val(h._val) != 0)
+            {
+                return std::nullopt;
+            }
+
+            // residue field part, k = k1 mod _m
+            unsigned_long_t k1 = 0;
+            if(_p == 2)
+            {
+                const bool negative = fmpz_fdiv_ui(padic_unit(h._val), 4) == 3;
+                if(negative && !_negative)
+                {
+                    return std::nullopt;
+                }
+                k1 = negative ? 1 : 0;
+            }
+            else
+            {
+                const unsigned_long_t h0 = fmpz_fdiv_ui(padic_unit(h._val), _p);
+                if(_pow(h0, _m) != 1)
+                {
+                    return std::nullopt;
+                }
+                unsigned_long_t M = 1;
+                for(const auto& C : _components)
+                {
+                    const auto kq = _component(C, h0);
+                    if(!kq)
+                    {
+                        return std::nullopt;
+                    }
+                    const unsigned_long_t t = n_mulmod2((*kq + C.qe - k1 % C.qe) % C.qe, n_invmod(M % C.qe, C.qe), C.qe);
+                    k1 += M * t;
+                    M *= C.qe;
+                }
+            }
+
+            // principal part, k = k2 mod p^_a
+            Fmpz k;
+            const PadicNumber L = log(_principal(h), _prec);
+            if(!padic_is_zero(L._val))
+            {
+                if(_a == 0 || padic_val(L._val) < _lgVal)
+                {
+                    return std::nullopt;
+                }
+                fmpz_t pa, e;
+                fmpz_init(e);
+                const int alloc = _padic_ctx_pow_ui(pa, _a, _ctx->get());
+                fmpz_pow_ui(e, _ctx->get()->p, padic_val(L._val) - _lgVal);
+                fmpz_mul(k.get(), padic_unit(L._val), _lgInv.get());
+                fmpz_mul(k.get(), k.get(), e);
+                fmpz_mod(k.get(), k.get(), pa);
+                if(alloc)
+                {
+                    fmpz_clear(pa);
+                }
+                fmpz_clear(e);
+            }
+
+            if(_p == 2)
+            {
+                if(_a == 0)
+                {
+                    k.set(k1);
+                }
+                else if(_negative ? fmpz_fdiv_ui(k.get(), 2) != k1 : k1 != 0)
+                {
+                    return std::nullopt;
+                }
+                return k;
+            }
+
+            // k = k1 + m·((k2 - k1)·m^-1 mod p^a)
+            if(_a > 0)
+            {
+                fmpz_t pa, minv;
+                fmpz_init(minv);
+                const int alloc = _padic_ctx_pow_ui(pa, _a, _ctx->get());
+                fmpz_sub_ui(k.get(), k.get(), k1);
+                fmpz_set_ui(minv, _m);
+                fmpz_invmod(minv, minv, pa);
+                fmpz_mul(k.get(), k.get(), minv);
+                fmpz_mod(k.get(), k.get(), pa);
+                if(alloc)
+                {
+                    fmpz_clear(pa);
+                }
+                fmpz_clear(minv);
+            }
+            fmpz_mul_ui(k.get(), k.get(), _m);
+            fmpz_add_ui(k.get(), k.get(), k1);
+            return k;
+        }
+
+        //! @brief Logarithms of all hs in parallel.
+        std::vector<std::optional<Fmpz>> operator()(std::span<const PadicNumber> hs, unsigned threads = 0) const
+        {
+            std::vector<std::optional<Fmpz>> result(hs.size());
+            parallel_for(hs.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    result[i] = (*this)(hs[i]);
+                }
+            }, threads);
+            return result;
+        }
+    };
+
+    //! @brief The k in [0, ord(g)) with g^k = h mod p^N, N = prec(g), or nothing. See PadicDlog.
+    std::optional<Fmpz> dlog(const PadicNumber& g, const PadicNumber& h)
+    {
+        return PadicDlog(g)(h);
+    }
+
+
+    //! @brief Square classes of Q_p^* and the Hilbert symbol on them.
+    //! @details The class of x = p^α·u is α mod 2 together with the Legendre symbol of u for odd
+    //!          p, or u mod 8 for p = 2, so products and symbols need only word arithmetic once
+    //!          the residue of the unit has been read.
+    class _SquareClasses
+    {
+    public:
+        struct Class
+        {
+            signed_long_t val;  // 0 or 1
+            int unit;           // (u/p) for odd p, u mod 8 for p = 2
+        };
+
+    private:
+        bool _two;
+        bool _threeModFour;     // p = 3 mod 4, so that -1 is not a square for odd p
+        bool _word;
+        unsigned_long_t _p;
+        const fmpz* _P;
+
+    public:
+        explicit _SquareClasses(const padic_ctx_t& ctx) : _P(ctx->p)
+        {
+            _two = fmpz_equal_ui(ctx->p, 2);
+            _threeModFour = fmpz_fdiv_ui(ctx->p, 4) == 3;
+            _word = fmpz_abs_fits_ui(ctx->p) && fmpz_get_ui(ctx->p) <= static_cast<unsigned_long_t>(WORD_MAX);
+            _p = _word ? fmpz_get_ui(ctx->p) : 0;
+        }
+
+        Class one() const
+        {
+            return { 0, 1 };
+        }
+
+        Class minusOne() const
+        {
+            return { 0, _two ? 7 : (_threeModFour ? -1 : 1) };
+        }
+
+        Class of(const PadicNumber& x) const
+        {
+            if(padic_is_zero(x._val))
+            {
+                throw std::domain_error("Zero has no square class.");
+            }
+            const fmpz* u = padic_unit(x._val);
+            int unit;
+            if(_two)
+            {
+                if(padic_prec(x._val) - padic_val(x._val) < 3)
+                {
+                    throw std::domain_error("The 2-adic square class needs the unit modulo 8.");
+                }
+                unit = static_cast<int>(fmpz_fdiv_ui(u, 8));
+            }
+            else if(_word)
+            {
+                unit = n_jacobi(static_cast<signed_long_t>(fmpz_fdiv_ui(u, _p)), _p);
+            }
+            else
+            {
+                unit = fmpz_jacobi(u, _P);
+            }
+            return { padic_val(x._val) & 1, unit };
+        }
+
+        Class mul(Class a, Class b) const
+        {
+            return { a.val ^ b.val, _two ? (a.unit * b.unit) % 8 : a.unit * b.unit };
+        }
+
+        //! @brief (a, b)_p by the formulas in Serre, A Course in Arithmetic, III.1.2.
+        int symbol(Class a, Class b) const
+        {
+            if(_two)
+            {
+                auto eps = [](int u) { return ((u - 1) / 2) & 1; };
+                auto omega = [](int u) { return ((u * u - 1) / 8) & 1; };
+                const int e = eps(a.unit) * eps(b.unit) + a.val * omega(b.unit) + b.val * omega(a.unit);
+                return e & 1 ? -1 : 1;
+            }
+            int s = (a.val & b.val) && _threeModFour ? -1 : 1;
+            if(b.val)
+            {
+                s *= a.unit;
+            }
+            if(a.val)
+            {
+                s *= b.unit;
+            }
+            return s;
+        }
+    };
+
+    //! @brief The Hilbert symbol (a, b)_p, 1 if a·x^2 + b·y^2 = z^2 has a nonzero solution and -1 otherwise.
+    int hilbert_symbol(const PadicNumber& a, const PadicNumber& b)
+    {
+        const _SquareClasses classes(a._getContext());
+        return classes.symbol(classes.of(a), classes.of(b));
+    }
+
+    //! @brief (a[i], b[i])_p for all i, in parallel. All elements must have the same context.
+    std::vector<int> hilbert_symbol(std::span<const PadicNumber> a, std::span<const PadicNumber> b, unsigned threads = 0)
+    {
+        if(a.size() != b.size())
+        {
+            throw std::invalid_argument("The spans must have the same length.");
+        }
+        std::vector<int> result(a.size());
+        if(a.empty())
+        {
+            return result;
+        }
+        const _SquareClasses classes(a[0]._getContext());
+        parallel_for(a.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                result[i] = classes.symbol(classes.of(a[i]), classes.of(b[i]));
+            }
+        }, threads);
+        return result;
+    }
+
+    //! @brief The local invariants of a nondegenerate quadratic form over Q_p.
+    //! @details Two forms are equivalent over Q_p iff dim, the discriminant in Q_p^*/Q_p^*2 and
+    //!          the Hasse–Witt invariant agree, which is what operator== compares.
+    struct PadicQuadraticInvariants
+    {
+        std::size_t dim = 0;
+        signed_long_t discVal = 0;  // valuation of the discriminant mod 2
+        int discUnit = 1;           // (u/p) of its unit for odd p, u mod 8 for p = 2
+        int hasse = 1;              // ∏_{i<j} (a_i, a_j)_p
+        bool isotropic = false;
+
+        friend bool operator == (const PadicQuadraticInvariants& lhs, const PadicQuadraticInvariants& rhs) = default;
+    };
+
+    //! @brief The invariants of the diagonal form a_1·x_1^2 + ... + a_n·x_n^2.
+    //! @details The Hasse–Witt invariant uses ∏_{i<j} (a_i, a_j) = ∏_j (a_1···a_(j-1), a_j), so
+    //!          the running discriminant gives it with n - 1 symbols. Isotropy follows
+    //!          Serre, IV.2.2, Theorem 6.
+    PadicQuadraticInvariants quadratic_invariants(std::span<const PadicNumber> diagonal)
+    {
+        PadicQuadraticInvariants inv;
+        inv.dim = diagonal.size();
+        if(diagonal.empty())
+        {
+            return inv;
+        }
+        const _SquareClasses classes(diagonal[0]._getContext());
+
+        auto d = classes.one();
+        for(const auto& a : diagonal)
+        {
+            const auto c = classes.of(a);
+            inv.hasse *= classes.symbol(d, c);
+            d = classes.mul(d, c);
+        }
+        inv.discVal = d.val;
+        inv.discUnit = d.unit;
+
+        auto same = [](_SquareClasses::Class x, _SquareClasses::Class y) { return x.val == y.val && x.unit == y.unit; };
+        const auto m1 = classes.minusOne();
+        switch(inv.dim)
+        {
+            case 1:
+                inv.isotropic = false;
+                break;
+            case 2:
+                inv.isotropic = same(d, m1);
+                break;
+            case 3:
+                inv.isotropic = classes.symbol(m1, classes.mul(m1, d)) == inv.hasse;
+                break;
+            case 4:
+                inv.isotropic = !same(d, classes.one()) || classes.symbol(m1, m1) == inv.hasse;
+                break;
+            default:
+                inv.isotropic = true;
+        }
+        return inv;
+    }
+
+    //! @brief quadratic_invariants() of many diagonal forms in parallel.
+    std::vector<PadicQuadraticInvariants> quadratic_invariants(std::span<const std::vector<PadicNumber>> forms, unsigned threads = 0)
+    {
+        std::vector<PadicQuadraticInvariants> result(forms.size());
+        parallel_for(forms.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                result[i] = quadratic_invariants(forms[i]);
+            }
+        }, threads);
+        return result;
+    }
+
+
+    //! @brief Conversion between integers and their images in Z_p at precision N for many primes at once.
+    //! @details The images are the remainders modulo p_i^N_i, computed for all i by one remainder
+    //!          tree (fmpz_multi_mod) over the product tree of the moduli. The inverse direction is
+    //!          CRT along the same tree (fmpz_multi_CRT). Both trees are built once, so every
+    //!          conversion costs quasi-linear time in the total size of the moduli.
+    class MultiPrimeConverter
+    {
+    private:
+        std::vector<std::shared_ptr<PadicContext>> _ctxs;
+        std::vector<signed_long_t> _precs;
+        std::vector<Fmpz> _moduli;
+        Fmpz _modulus;
+        fmpz_multi_mod_t _mod;
+        fmpz_multi_CRT_t _crt;
+
+        using _Factors = std::pair<std::vector<std::shared_ptr<PadicContext>>, std::vector<signed_long_t>>;
+
+        static _Factors _factor(const Fmpz& n)
+        {
+            if(fmpz_cmp_ui(n.get(), 2) < 0)
+            {
+                throw std::invalid_argument("The modulus must be at least 2.");
+            }
+            fmpz_factor_t fac;
+            fmpz_factor_init(fac);
+            fmpz_factor(fac, n.get());
+            _Factors factors;
+            for(slong i = 0; i < fac->num; i++)
+            {
+                Fmpz p;
+                fmpz_set(p.get(), fac->p + i);
+                factors.first.push_back(std::make_shared<PadicContext>(p));
+                factors.second.push_back(static_cast<signed_long_t>(fac->exp[i]));
+            }
+            fmpz_factor_clear(fac);
+            return factors;
+        }
+
+        explicit MultiPrimeConverter(_Factors&& factors) : MultiPrimeConverter(std::move(factors.first), std::move(factors.second))
+        {
+        }
+
+    public:
+        //! @brief The converter for Z/nZ, with one context p^N per prime-power factor of n.
+        explicit MultiPrimeConverter(const Fmpz& n) : MultiPrimeConverter(_factor(n))
+        {
+        }
+
+        //! @param ctxs Contexts for distinct primes.
+        //! @param prec The precision N used for every prime.
+        MultiPrimeConverter(std::vector<std::shared_ptr<PadicContext>> ctxs, signed_long_t prec = PADIC_DEFAULT_PREC)
+            : MultiPrimeConverter(ctxs, std::vector<signed_long_t>(ctxs.size(), prec))
+        {
+        }
+
+        //! @param precs The precision N_i for every context.
+        MultiPrimeConverter(std::vector<std::shared_ptr<PadicContext>> ctxs, std::vector<signed_long_t> precs)
+            : _ctxs(std::move(ctxs)), _precs(std::move(precs)), _moduli(_ctxs.size())
+        {
+            if(_ctxs.size() != _precs.size() || _ctxs.empty())
+            {
+                throw std::invalid_argument("There must be one precision per context, and at least one context.");
+            }
+            fmpz_one(_modulus.get());
+            for(std::size_t i = 0; i < _ctxs.size(); i++)
+            {
+                if(_precs[i] <= 0)
+                {
+                    throw std::invalid_argument("The precisions must be positive.");
+                }
+                fmpz_pow_ui(_moduli[i].get(), _ctxs[i]->get()->p, _precs[i]);
+                fmpz_mul(_modulus.get(), _modulus.get(), _moduli[i].get());
+            }
+
+            std::vector<const fmpz*> primes(_ctxs.size());
+            for(std::size_t i = 0; i < _ctxs.size(); i++)
+            {
+                primes[i] = _ctxs[i]->get()->p;
+            }
+            std::sort(primes.begin(), primes.end(), [](const fmpz* a, const fmpz* b) { return fmpz_cmp(a, b) < 0; });
+            if(std::adjacent_find(primes.begin(), primes.end(), [](const fmpz* a, const fmpz* b) { return fmpz_equal(a, b); }) != primes.end())
+            {
+                throw std::invalid_argument("The primes must be distinct.");
+            }
+
+            std::vector<fmpz> moduli(_moduli.size());
+            for(std::size_t i = 0; i < _moduli.size(); i++)
+            {
+                moduli[i] = *_moduli[i].get();
+            }
+            fmpz_multi_mod_init(_mod);
+            fmpz_multi_CRT_init(_crt);
+            if(!fmpz_multi_mod_precompute(_mod, moduli.data(), moduli.size()) || !fmpz_multi_CRT_precompute(_crt, moduli.data(), moduli.size()))
+            {
+                fmpz_multi_mod_clear(_mod);
+                fmpz_multi_CRT_clear(_crt);
+                throw std::runtime_error("Precomputing the product tree failed.");
+            }
+        }
+
+        MultiPrimeConverter(const MultiPrimeConverter&) = delete;
+        MultiPrimeConverter& operator = (const MultiPrimeConverter&) = delete;
+
+        ~MultiPrimeConverter()
+        {
+            fmpz_multi_mod_clear(_mod);
+            fmpz_multi_CRT_clear(_crt);
+        }
+
+        std::size_t size() const
+        {
+            return _ctxs.size();
+        }
+
+        const std::shared_ptr<PadicContext>& context(std::size_t i) const
+        {
+            return _ctxs[i];
+        }
+
+        signed_long_t prec(std::size_t i) const
+        {
+            return _precs[i];
+        }
+
+        //! @brief The product of all p_i^N_i.
+        const Fmpz& modulus() const
+        {
+            return _modulus;
+        }
+
+        //! @brief The images of x in Z_p_i at precision N_i.
+        std::vector<PadicNumber> images(const Fmpz& x) const
+        {
+            std::vector<fmpz> residues(_ctxs.size());
+            for(auto& r : residues)
+            {
+                fmpz_init(&r);
+            }
+            fmpz_multi_mod_precomp(residues.data(), _mod, x.get(), 0);
+
+            std::vector<PadicNumber> result;
+            result.reserve(_ctxs.size());
+            for(std::size_t i = 0; i < _ctxs.size(); i++)
+            {
+                PadicNumber y(_ctxs[i], _precs[i]);
+                padic_set_fmpz(y._val, &residues[i], _ctxs[i]->get());
+                result.push_back(std::move(y));
+                fmpz_clear(&residues[i]);
+            }
+            return result;
+        }
+
+        //! @brief images() for many integers.
+        std::vector<std::vector<PadicNumber>> images(std::span<const Fmpz> xs) const
+        {
+            std::vector<std::vector<PadicNumber>> result;
+            result.reserve(xs.size());
+            for(const auto& x : xs)
+            {
+                result.push_back(images(x));
+            }
+            return result;
+        }
+
+        //! @brief The integer with the given images, in [0, modulus()) or in the symmetric range.
+        //! @param images One p-adic integer per context, read modulo p_i^N_i.
+        Fmpz reconstruct(std::span<const PadicNumber> images, bool symmetric = false) const
+        {
+            if(images.size() != _ctxs.size())
+            {
+                throw std::invalid_argument("There must be one image per context.");
+            }
+            std::vector<fmpz> residues(_ctxs.size());
+            for(auto& r : residues)
+            {
+                fmpz_init(&r);
+            }
+            for(std::size_t i = 0; i < _ctxs.size(); i++)
+            {
+                const padic_struct* x = images[i]._val;
+                if(padic_is_zero(x) || padic_val(x) >= _precs[i])
+                {
+                    continue;
+                }
+                if(padic_val(x) < 0)
+                {
+                    for(auto& r : residues)
+                    {
+                        fmpz_clear(&r);
+                    }
+                    throw std::domain_error("The images must be p-adic integers.");
+                }
+                fmpz_pow_ui(&residues[i], _ctxs[i]->get()->p, padic_val(x));
+                fmpz_mul(&residues[i], &residues[i], padic_unit(x));
+                fmpz_mod(&residues[i], &residues[i], _moduli[i].get());
+            }
+
+            Fmpz y;
+            fmpz_multi_CRT_precomp(y.get(), _crt, residues.data(), symmetric);
+            for(auto& r : residues)
+            {
+                fmpz_clear(&r);
+            }
+            return y;
+        }
+    };
+
+
+    //! @brief Runs one computation in Q_p for every prime of a range.
+    //! @details The contexts are built once (in parallel) and reused by every run(). Work is
+    //!          handed out one prime at a time, largest prime first, so the expensive primes
+    //!          start early and the cheap ones fill the gaps at the end.
+    class MultiPrimeRunner
+    {
+    private:
+        std::vector<std::shared_ptr<PadicContext>> _ctxs;
+
+    public:
+        //! @brief The primes lo <= p <= hi.
+        MultiPrimeRunner(unsigned_long_t lo, unsigned_long_t hi, unsigned threads = 0)
+        {
+            std::vector<unsigned_long_t> primes;
+            for(unsigned_long_t p = n_nextprime(lo > 0 ? lo - 1 : 0, 1); p <= hi && p >= lo; p = n_nextprime(p, 1))
+            {
+                primes.push_back(p);
+            }
+
+            _ctxs.resize(primes.size());
+            parallel_for(primes.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    Fmpz p;
+                    p.set(primes[i]);
+                    _ctxs[i] = std::make_shared<PadicContext>(p);
+                }
+            }, threads);
+        }
+
+        //! @brief Reuses existing contexts.
+        explicit MultiPrimeRunner(std::vector<std::shared_ptr<PadicContext>> ctxs) : _ctxs(std::move(ctxs))
+        {
+        }
+
+        std::size_t size() const
+        {
+            return _ctxs.size();
+        }
+
+        const std::vector<std::shared_ptr<PadicContext>>& contexts() const
+        {
+            return _ctxs;
+        }
+
+        //! @brief fn(ctx) for every context, in the order of contexts().
+        //! @param fn Called concurrently from several threads, with a different context each time.
+        //! @param threads The number of threads, 0 for the hardware concurrency.
+        template<typename F>
+        auto run(F&& fn, unsigned threads = 0) const -> std::vector<std::invoke_result_t<F&, const std::shared_ptr<PadicContext>&>>
+        {
+            using Result = std::invoke_result_t<F&, const std::shared_ptr<PadicContext>&>;
+            const std::size_t n = _ctxs.size();
+
+            std::vector<std::size_t> schedule(n);
+            for(std::size_t i = 0; i < n; i++)
+            {
+                schedule[i] = i;
+            }
+            std::stable_sort(schedule.begin(), schedule.end(), [this](std::size_t a, std::size_t b)
+            {
+                return fmpz_cmp(_ctxs[a]->get()->p, _ctxs[b]->get()->p) > 0;
+            });
+
+            if(threads == 0)
+            {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threads = static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threads, n)));
+
+            std::vector<std::optional<Result>> results(n);
+            std::atomic<std::size_t> next{ 0 };
+            parallel_for(threads, [&](std::size_t, std::size_t)
+            {
+                for(std::size_t k = next++; k < n; k = next++)
+                {
+                    const std::size_t i = schedule[k];
+                    results[i].emplace(fn(_ctxs[i]));
+                }
+            }, threads);
+
+            std::vector<Result> gathered;
+            gathered.reserve(n);
+            for(auto& result : results)
+            {
+                gathered.push_back(std::move(*result));
+            }
+            return gathered;
+        }
+    };
+
+
+    //! @brief An element of Z/nZ, or of the product of Z_p/p^N over several primes, held as one
+    //!        PadicNumber per prime-power factor.
+    //! @details Arithmetic acts on the components independently. The integer is only reconstructed
+    //!          by CRT when get() asks for it.
+    class CrtNumber
+    {
+    private:
+        std::shared_ptr<const MultiPrimeConverter> _modulus;
+        std::vector<PadicNumber> _components;
+
+        static void _check(const CrtNumber& lhs, const CrtNumber& rhs)
+        {
+            if(lhs._modulus != rhs._modulus)
+            {
+                throw std::invalid_argument("The operands must share their modulus.");
+            }
+        }
+
+    public:
+        //! @brief Zero.
+        explicit CrtNumber(std::shared_ptr<const MultiPrimeConverter> modulus) : _modulus(std::move(modulus))
+        {
+            _components.reserve(_modulus->size());
+            for(std::size_t i = 0; i < _modulus->size(); i++)
+            {
+                _components.emplace_back(_modulus->context(i), _modulus->prec(i));
+            }
+        }
+
+        void set(const Fmpz& val)
+        {
+            _components = _modulus->images(val);
+        }
+
+        void set(const signed_long_t val)
+        {
+            for(std::size_t i = 0; i < _components.size(); i++)
+            {
+                padic_set_si(_components[i]._val, val, _modulus->context(i)->get());
+            }
+        }
+
+        //! @brief The CRT reconstruction, in [0, n) or in the symmetric range.
+        Fmpz get(bool symmetric = false) const
+        {
+            return _modulus->reconstruct(_components, symmetric);
+        }
+
+        const std::shared_ptr<const MultiPrimeConverter>& modulus() const
+        {
+            return _modulus;
+        }
+
+        std::span<const PadicNumber> components() const
+        {
+            return _components;
+        }
+
+        //! @brief True if every component is a unit.
+        bool isUnit() const
+        {
+            return std::all_of(_components.begin(), _components.end(), [](const PadicNumber& x)
+            {
+                return !padic_is_zero(x._val) && padic_val(x._val) == 0;
+            });
+        }
+
+        friend CrtNumber operator + (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend CrtNumber operator - (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend CrtNumber operator * (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend bool operator == (const CrtNumber& lhs, const CrtNumber& rhs);
+        friend CrtNumber inv(const CrtNumber& x);
+        friend CrtNumber pow(const CrtNumber& x, const Fmpz& e, unsigned threads);
+    };
+
+    CrtNumber operator + (const CrtNumber& lhs, const CrtNumber& rhs)
+    {
+        CrtNumber::_check(lhs, rhs);
+        CrtNumber y(lhs._modulus);
+        for(std::size_t i = 0; i < y._components.size(); i++)
+        {
+            padic_add(y._components[i]._val, lhs._components[i]._val, rhs._components[i]._val, lhs._modulus->context(i)->get());
+        }
+        return y;
+    }
+
+    CrtNumber operator - (const CrtNumber& lhs, const CrtNumber& rhs)
+    {
+        CrtNumber::_check(lhs, rhs);
+        CrtNumber y(lhs._modulus);
+        for(std::size_t i = 0; i < y._components.size(); i++)
+        {
+            padic_sub(y._components[i]._val, lhs._components[i]._val, rhs._components[i]._val, lhs._modulus->context(i)->get());
+        }
+        return y;
+    }
+
+    CrtNumber operator * (const CrtNumber& lhs, const CrtNumber& rhs)
+    {
+        CrtNumber::_check(lhs, rhs);
+        CrtNumber y(lhs._modulus);
+        for(std::size_t i = 0; i < y._components.size(); i++)
+        {
+            padic_mul(y._components[i]._val, lhs._components[i]._val, rhs._components[i]._val, lhs._modulus->context(i)->get());
+        }
+        return y;
+    }
+
+    bool operator == (const CrtNumber& lhs, const CrtNumber& rhs)
+    {
+        CrtNumber::_check(lhs, rhs);
+        return std::equal(lhs._components.begin(), lhs._components.end(), rhs._components.begin());
+    }
+
+    //! @brief The inverse of a unit of Z/nZ.
+    CrtNumber inv(const CrtNumber& x)
+    {
+        if(!x.isUnit())
+        {
+            throw std::domain_error("Only units can be inverted.");
+        }
+        CrtNumber y(x._modulus);
+        for(std::size_t i = 0; i < y._components.size(); i++)
+        {
+            padic_inv(y._components[i]._val, x._components[i]._val, x._modulus->context(i)->get());
+        }
+        return y;
+    }
+
+    //! @brief Raise x to an integer power, one component per task.
+    //! @param e The exponent, may be negative if x is a unit.
+    //! @param threads The number of threads, 0 for the hardware concurrency.
+    CrtNumber pow(const CrtNumber& x, const Fmpz& e, unsigned threads = 1)
+    {
+        if(fmpz_sgn(e.get()) < 0 && !x.isUnit())
+        {
+            throw std::domain_error("Only units can be raised to a negative power.");
+        }
+        CrtNumber y(x._modulus);
+        parallel_for(y._components.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                y._components[i] = pow(x._components[i], e, x._modulus->prec(i));
+            }
+        }, threads);
+        return y;
+    }
+
+
+    //! @brief Removes a fixed word-size prime from words without dividing.
+    //! @details For odd p, u is divisible by p exactly when u·p^-1 mod 2^64 <= (2^64 - 1) / p,
+    //!          and the product is then the quotient (exact division by an invariant). Powers of
+    //!          two are counted with countr_zero.
+    class _WordValuation
+    {
+    private:
+        unsigned_long_t _p;
+        unsigned_long_t _inverse = 0;
+        unsigned_long_t _limit = 0;
+
+    public:
+        explicit _WordValuation(unsigned_long_t p) : _p(p)
+        {
+            if(p == 2)
+            {
+                return;
+            }
+            // Newton iteration doubles the number of correct low bits, starting from 3
+            _inverse = p;
+            for(int i = 0; i < 5; i++)
+            {
+                _inverse *= 2 - p * _inverse;
+            }
+            _limit = ~unsigned_long_t(0) / p;
+        }
+
+        //! @brief The valuation of u != 0, which is replaced by its p-free part.
+        signed_long_t operator()(unsigned_long_t& u) const
+        {
+            if(_p == 2)
+            {
+                const int v = std::countr_zero(u);
+                u >>= v;
+                return v;
+            }
+            signed_long_t v = 0;
+            for(unsigned_long_t q = u * _inverse; q <= _limit; q = u * _inverse)
+            {
+                u = q;
+                v++;
+            }
+            return v;
+        }
+    };
+
+    //! @brief v_p of many words, std::nullopt for zero.
+    //! @param p A prime that fits into a word.
+    std::vector<std::optional<signed_long_t>> valuations(std::span<const unsigned_long_t> xs, unsigned_long_t p, unsigned threads = 0)
+    {
+        if(!n_is_prime(p))
+        {
+            throw std::invalid_argument("The base of a batch valuation must be a prime.");
+        }
+        const _WordValuation valuation(p);
+        std::vector<std::optional<signed_long_t>> result(xs.size());
+        parallel_for(xs.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                unsigned_long_t u = xs[i];
+                if(u != 0)
+                {
+                    result[i] = valuation(u);
+                }
+            }
+        }, threads);
+        return result;
+    }
+
+    //! @brief v_p of many integers, std::nullopt for zero.
+    //! @details Word-size values take the division-free path, the others fmpz_remove.
+    //! @param p A prime that fits into a word.
+    std::vector<std::optional<signed_long_t>> valuations(std::span<const Fmpz> xs, unsigned_long_t p, unsigned threads = 0)
+    {
+        if(!n_is_prime(p))
+        {
+            throw std::invalid_argument("The base of a batch valuation must be a prime.");
+        }
+        const _WordValuation valuation(p);
+        std::vector<std::optional<signed_long_t>> result(xs.size());
+        parallel_for(xs.size(), [&](std::size_t begin, std::size_t end)
+        {
+            fmpz_t q, rest;
+            fmpz_init_set_ui(q, p);
+            fmpz_init(rest);
+            for(std::size_t i = begin; i < end; i++)
+            {
+                const fmpz* x = xs[i].get();
+                if(fmpz_is_zero(x))
+                {
+                    continue;
+                }
+                if(!COEFF_IS_MPZ(*x))
+                {
+                    unsigned_long_t u = *x < 0 ? -static_cast<unsigned_long_t>(*x) : static_cast<unsigned_long_t>(*x);
+                    result[i] = valuation(u);
+                }
+                else
+                {
+                    result[i] = fmpz_remove(rest, x, q);
+                }
+            }
+            fmpz_clear(q);
+            fmpz_clear(rest);
+        }, threads);
+        return result;
+    }
+
+    //! @brief The sum of the base-p digits of n.
+    unsigned_long_t _digitSum(unsigned_long_t n, unsigned_long_t p)
+    {
+        unsigned_long_t s = 0;
+        for(; n > 0; n /= p)
+        {
+            s += n % p;
+        }
+        return s;
+    }
+
+    //! @brief v_p(n!) = (n - s_p(n)) / (p - 1) by Legendre's formula, s_p being the base-p digit sum.
+    //! @param p A prime.
+    unsigned_long_t factorial_valuation(unsigned_long_t n, unsigned_long_t p)
+    {
+        if(!n_is_prime(p))
+        {
+            throw std::invalid_argument("Legendre's formula needs a prime.");
+        }
+        return (n - _digitSum(n, p)) / (p - 1);
+    }
+
+    //! @brief v_p(binomial(n, k)), the number of carries when adding k and n - k in base p (Kummer).
+    //! @param p A prime.
+    unsigned_long_t binomial_valuation(unsigned_long_t n, unsigned_long_t k, unsigned_long_t p)
+    {
+        if(!n_is_prime(p))
+        {
+            throw std::invalid_argument("Kummer's theorem needs a prime.");
+        }
+        if(k > n)
+        {
+            throw std::domain_error("The valuation of zero is infinite.");
+        }
+        return (_digitSum(k, p) + _digitSum(n - k, p) - _digitSum(n, p)) / (p - 1);
+    }
+
+
+    //! @brief The primes up to a bound in an integer, see SmoothFactoriser.
+    struct SmoothFactorisation
+    {
+        //! @brief (p, v_p(x)) for the primes p <= bound dividing x, in increasing order of p.
+        std::vector<std::pair<unsigned_long_t, signed_long_t>> valuations;
+        //! @brief |x| without those primes, it has no prime factor <= bound.
+        Fmpz cofactor;
+
+        bool isSmooth() const
+        {
+            return fmpz_is_one(cofactor.get());
+        }
+    };
+
+    //! @brief Valuations at all primes up to a bound for many integers at once (Bernstein).
+    //! @details The product P of the primes is reduced modulo every input by a remainder tree over
+    //!          the product tree of the inputs. For x with remainder r, gcd(x, r^(2^e) mod x) with
+    //!          2^e >= log2|x| is the smooth part of x. The primes of all smooth parts are then
+    //!          found together, by splitting the primes dividing their product down the product
+    //!          tree of the smooth parts.
+    class SmoothFactoriser
+    {
+    private:
+        using _Tree = std::vector<std::vector<Fmpz>>;
+
+        unsigned_long_t _bound;
+        _Tree _primes;
+
+        //! @brief Level 0 are the leaves, every level above holds the products of pairs.
+        static _Tree _productTree(std::vector<Fmpz> leaves, unsigned threads)
+        {
+            _Tree tree;
+            tree.push_back(std::move(leaves));
+            while(tree.back().size() > 1)
+            {
+                const auto& below = tree.back();
+                std::vector<Fmpz> level((below.size() + 1) / 2);
+                parallel_for(level.size(), [&](std::size_t begin, std::size_t end)
+                {
+                    for(std::size_t i = begin; i < end; i++)
+                    {
+                        if(2 * i + 1 < below.size())
+                        {
+                            fmpz_mul(level[i].get(), below[2 * i].get(), below[2 * i + 1].get());
+                        }
+                        else
+                        {
+                            level[i] = below[2 * i];
+                        }
+                    }
+                }, threads);
+                tree.push_back(std::move(level));
+            }
+            return tree;
+        }
+
+        //! @brief The leaves of the prime product tree that divide g, in increasing order.
+        //! @details g is reduced modulo every node by a remainder tree, so the cost is quasi-linear
+        //!          in the sizes of g and of the primes together.
+        static std::vector<unsigned_long_t> _dividing(const fmpz_t g, const _Tree& primes, unsigned threads)
+        {
+            std::vector<Fmpz> above(1);
+            fmpz_mod(above[0].get(), g, primes.back()[0].get());
+            for(std::size_t level = primes.size() - 1; level-- > 0;)
+            {
+                std::vector<Fmpz> current(primes[level].size());
+                parallel_for(current.size(), [&](std::size_t begin, std::size_t end)
+                {
+                    for(std::size_t i = begin; i < end; i++)
+                    {
+                        fmpz_mod(current[i].get(), above[i / 2].get(), primes[level][i].get());
+                    }
+                }, threads);
+                above = std::move(current);
+            }
+
+            std::vector<unsigned_long_t> found;
+            for(std::size_t i = 0; i < above.size(); i++)
+            {
+                if(fmpz_is_zero(above[i].get()))
+                {
+                    found.push_back(fmpz_get_ui(primes[0][i].get()));
+                }
+            }
+            return found;
+        }
+
+        //! @brief The primes of candidates that divide g, in increasing order.
+        //! @details Short lists are tested prime by prime, longer ones through their own product tree.
+        static std::vector<unsigned_long_t> _dividing(const fmpz_t g, std::span<const unsigned_long_t> candidates)
+        {
+            std::vector<unsigned_long_t> found;
+            if(candidates.size() <= 16)
+            {
+                for(auto p : candidates)
+                {
+                    if(fmpz_fdiv_ui(g, p) == 0)
+                    {
+                        found.push_back(p);
+                    }
+                }
+                return found;
+            }
+            std::vector<Fmpz> leaves(candidates.size());
+            for(std::size_t i = 0; i < candidates.size(); i++)
+            {
+                leaves[i].set(candidates[i]);
+            }
+            return _dividing(g, _productTree(std::move(leaves), 1), 1);
+        }
+
+    public:
+        //! @param bound The largest prime to look for, at least 2.
+        explicit SmoothFactoriser(unsigned_long_t bound, unsigned threads = 0) : _bound(bound)
+        {
+            if(bound < 2)
+            {
+                throw std::invalid_argument("The smoothness bound must be at least 2.");
+            }
+            std::vector<Fmpz> primes;
+            for(unsigned_long_t p = 2; p <= bound; p = n_nextprime(p, 1))
+            {
+                primes.emplace_back().set(p);
+            }
+            _primes = _productTree(std::move(primes), threads);
+        }
+
+        unsigned_long_t bound() const
+        {
+            return _bound;
+        }
+
+        //! @brief The number of primes up to the bound.
+        std::size_t primeCount() const
+        {
+            return _primes[0].size();
+        }
+
+        //! @brief The factorisations of xs over the primes up to the bound, std::nullopt for zero.
+        std::vector<std::optional<SmoothFactorisation>> operator()(std::span<const Fmpz> xs, unsigned threads = 0) const
+        {
+            std::vector<std::optional<SmoothFactorisation>> result(xs.size());
+            std::vector<std::size_t> indices;
+            std::vector<Fmpz> leaves;
+            for(std::size_t i = 0; i < xs.size(); i++)
+            {
+                if(!fmpz_is_zero(xs[i].get()))
+                {
+                    indices.push_back(i);
+                    fmpz_abs(leaves.emplace_back().get(), xs[i].get());
+                }
+            }
+            if(indices.empty())
+            {
+                return result;
+            }
+
+            // P mod every |x|, top-down through the product tree of the inputs
+            const _Tree tree = _productTree(std::move(leaves), threads);
+            std::vector<Fmpz> above(1);
+            fmpz_mod(above[0].get(), _primes.back()[0].get(), tree.back()[0].get());
+            for(std::size_t level = tree.size() - 1; level-- > 0;)
+            {
+                std::vector<Fmpz> current(tree[level].size());
+                parallel_for(current.size(), [&](std::size_t begin, std::size_t end)
+                {
+                    for(std::size_t i = begin; i < end; i++)
+                    {
+                        fmpz_mod(current[i].get(), above[i / 2].get(), tree[level][i].get());
+                    }
+                }, threads);
+                above = std::move(current);
+            }
+
+            // the smooth parts gcd(x, (P mod x)^(2^e) mod x), with 2^e >= bits(x) >= every exponent in x
+            std::vector<Fmpz> smooth(indices.size());
+            parallel_for(indices.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t k = begin; k < end; k++)
+                {
+                    const fmpz* x = tree[0][k].get();
+                    fmpz* y = above[k].get();
+                    for(unsigned_long_t bits = 1; bits < fmpz_bits(x); bits *= 2)
+                    {
+                        fmpz_mul(y, y, y);
+                        fmpz_mod(y, y, x);
+                    }
+                    fmpz_gcd(smooth[k].get(), x, y);
+                }
+            }, threads);
+
+            // Split the primes down the product tree of the smooth parts: the root keeps the primes
+            // dividing the product of all smooth parts, every other node those of its parent that
+            // divide its own product. Each candidate divides the node's product, so the candidates
+            // of a level are never larger than the smooth parts themselves.
+            const _Tree smoothTree = _productTree(std::move(smooth), threads);
+            std::vector<std::vector<unsigned_long_t>> candidates(1);
+            candidates[0] = _dividing(smoothTree.back()[0].get(), _primes, threads);
+            for(std::size_t level = smoothTree.size() - 1; level-- > 0;)
+            {
+                std::vector<std::vector<unsigned_long_t>> current(smoothTree[level].size());
+                parallel_for(current.size(), [&](std::size_t begin, std::size_t end)
+                {
+                    for(std::size_t i = begin; i < end; i++)
+                    {
+                        current[i] = _dividing(smoothTree[level][i].get(), candidates[i / 2]);
+                    }
+                }, threads);
+                candidates = std::move(current);
+            }
+
+            parallel_for(indices.size(), [&](std::size_t begin, std::size_t end)
+            {
+                fmpz_t q;
+                fmpz_init(q);
+                for(std::size_t k = begin; k < end; k++)
+                {
+                    SmoothFactorisation f;
+                    fmpz_set(f.cofactor.get(), tree[0][k].get());
+                    for(auto p : candidates[k])
+                    {
+                        fmpz_set_ui(q, p);
+                        f.valuations.emplace_back(p, fmpz_remove(f.cofactor.get(), f.cofactor.get(), q));
+                    }
+                    result[indices[k]] = std::move(f);
+                }
+                fmpz_clear(q);
+            }, threads);
+            return result;
+        }
+    };
+
+
+    //! @brief Factorials and binomial coefficients of word-size arguments modulo p^N.
+    //! @details n! = p^v(n!) · ∏_t F(⌊n/p^t⌋), where F(m) is the product of the integers up to m
+    //!          prime to p (the factorial splitting behind the p-adic Gamma function), and binomials
+    //!          are the ratio of three such products (Granville's generalisation of Lucas' theorem).
+    //!          With B(x) = (x + 1)···(x + p - 1) and m = q·p + r,
+    //!              F(m) = B(0)·B(p)···B((q - 1)·p) · (q·p + 1)···(q·p + r).
+    //!          Only multiples of p are ever substituted for x, so B and the products Q_q(x) =
+    //!          B(x)···B(x + (q - 1)·p) are exact modulo p^N when truncated below degree N. Q_q is built
+    //!          by doubling, Q_2m(x) = Q_m(x)·Q_m(x + m·p), in O(N^2 log q) operations modulo p^N.
+    //!          Building B costs O(p·N), so p should be moderate.
+    class PadicFactorial
+    {
+    private:
+        using _Poly = std::vector<Fmpz>;
+
+        std::shared_ptr<PadicContext> _ctx;
+        signed_long_t _prec;
+        unsigned_long_t _p;
+        Fmpz _modulus;
+        _Poly _block;
+        std::vector<_Poly> _binomials;
+
+        //! @brief a·b truncated below degree _prec.
+        _Poly _mul(const _Poly& a, const _Poly& b) const
+        {
+            _Poly c(std::min<std::size_t>(a.size() + b.size() - 1, _prec));
+            for(std::size_t i = 0; i < a.size(); i++)
+            {
+                for(std::size_t j = 0; i + j < c.size() && j < b.size(); j++)
+                {
+                    fmpz_addmul(c[i + j].get(), a[i].get(), b[j].get());
+                }
+            }
+            for(auto& x : c)
+            {
+                fmpz_mod(x.get(), x.get(), _modulus.get());
+            }
+            return c;
+        }
+
+        //! @brief a(x + s), the coefficient of x^k being Σ_{i >= k} binomial(i, k)·s^(i - k)·a_i.
+        _Poly _shift(const _Poly& a, const Fmpz& s) const
+        {
+            _Poly powers(a.size());
+            fmpz_one(powers[0].get());
+            for(std::size_t i = 1; i < a.size(); i++)
+            {
+                fmpz_mul(powers[i].get(), powers[i - 1].get(), s.get());
+                fmpz_mod(powers[i].get(), powers[i].get(), _modulus.get());
+            }
+
+            _Poly b(a.size());
+            fmpz_t t;
+            fmpz_init(t);
+            for(std::size_t k = 0; k < a.size(); k++)
+            {
+                for(std::size_t i = k; i < a.size(); i++)
+                {
+                    fmpz_mul(t, _binomials[i][k].get(), powers[i - k].get());
+                    fmpz_addmul(b[k].get(), t, a[i].get());
+                }
+                fmpz_mod(b[k].get(), b[k].get(), _modulus.get());
+            }
+            fmpz_clear(t);
+            return b;
+        }
+
+        //! @brief F(m) modulo p^N.
+        Fmpz _coprimeFactorial(unsigned_long_t m) const
+        {
+            const unsigned_long_t q = m / _p;
+            const unsigned_long_t r = m % _p;
+
+            // Q_c for the leading bits c of q
+            _Poly Q(1);
+            fmpz_one(Q[0].get());
+            unsigned_long_t c = 0;
+            Fmpz s;
+            for(int bit = std::bit_width(q) - 1; bit >= 0; bit--)
+            {
+                fmpz_set_ui(s.get(), c);
+                fmpz_mul_ui(s.get(), s.get(), _p);
+                Q = _mul(Q, _shift(Q, s));
+                c *= 2;
+                if((q >> bit) & 1)
+                {
+                    fmpz_set_ui(s.get(), c);
+                    fmpz_mul_ui(s.get(), s.get(), _p);
+                    Q = _mul(Q, _shift(_block, s));
+                    c++;
+                }
+            }
+
+            Fmpz y;
+            fmpz_set(y.get(), Q[0].get());
+            fmpz_set_ui(s.get(), q);
+            fmpz_mul_ui(s.get(), s.get(), _p);
+            fmpz_t t;
+            fmpz_init(t);
+            for(unsigned_long_t j = 1; j <= r; j++)
+            {
+                fmpz_add_ui(t, s.get(), j);
+                fmpz_mul(y.get(), y.get(), t);
+                fmpz_mod(y.get(), y.get(), _modulus.get());
+            }
+            fmpz_clear(t);
+            return y;
+        }
+
+        //! @brief The unit part of n! modulo p^N.
+        Fmpz _unitFactorial(unsigned_long_t n) const
+        {
+            Fmpz u;
+            fmpz_one(u.get());
+            for(; n > 0; n /= _p)
+            {
+                fmpz_mul(u.get(), u.get(), _coprimeFactorial(n).get());
+                fmpz_mod(u.get(), u.get(), _modulus.get());
+            }
+            return u;
+        }
+
+        PadicNumber _make(const Fmpz& u, unsigned_long_t v) const
+        {
+            PadicNumber y(_ctx, _prec);
+            if(v < static_cast<unsigned_long_t>(_prec))
+            {
+                fmpz_set(padic_unit(y._val), u.get());
+                padic_val(y._val) = static_cast<signed_long_t>(v);
+                _padic_reduce(y._val, _ctx->get());
+            }
+            return y;
+        }
+
+    public:
+        //! @param ctx A context for a prime that fits into a word.
+        //! @param prec The precision N of the results.
+        PadicFactorial(std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC)
+            : _ctx(std::move(ctx)), _prec(prec)
+        {
+            if(prec <= 0)
+            {
+                throw std::invalid_argument("The precision must be positive.");
+            }
+            if(!fmpz_abs_fits_ui(_ctx->get()->p))
+            {
+                throw std::invalid_argument("The prime must fit into a word.");
+            }
+            _p = fmpz_get_ui(_ctx->get()->p);
+            fmpz_pow_ui(_modulus.get(), _ctx->get()->p, prec);
+
+            _binomials.resize(prec);
+            for(signed_long_t i = 0; i < prec; i++)
+            {
+                _binomials[i].resize(i + 1);
+                fmpz_one(_binomials[i][0].get());
+                fmpz_one(_binomials[i][i].get());
+                for(signed_long_t k = 1; k < i; k++)
+                {
+                    fmpz_add(_binomials[i][k].get(), _binomials[i - 1][k - 1].get(), _binomials[i - 1][k].get());
+                }
+            }
+
+            // B(x) = (x + 1)···(x + p - 1)
+            _block.resize(1);
+            fmpz_one(_block[0].get());
+            _Poly linear(2);
+            fmpz_one(linear[1].get());
+            for(unsigned_long_t j = 1; j < _p; j++)
+            {
+                fmpz_set_ui(linear[0].get(), j);
+                _block = _mul(_block, linear);
+            }
+        }
+
+        signed_long_t prec() const
+        {
+            return _prec;
+        }
+
+        //! @brief n! at precision N.
+        PadicNumber factorial(unsigned_long_t n) const
+        {
+            return _make(_unitFactorial(n), factorial_valuation(n, _p));
+        }
+
+        //! @brief binomial(n, k) at precision N, zero if k > n.
+        PadicNumber binomial(unsigned_long_t n, unsigned_long_t k) const
+        {
+            if(k > n)
+            {
+                return PadicNumber(_ctx, _prec);
+            }
+            const unsigned_long_t v = binomial_valuation(n, k, _p);
+            if(v >= static_cast<unsigned_long_t>(_prec))
+            {
+                return PadicNumber(_ctx, _prec);
+            }
+            Fmpz u = _unitFactorial(n);
+            Fmpz d = _unitFactorial(k);
+            fmpz_mul(d.get(), d.get(), _unitFactorial(n - k).get());
+            fmpz_invmod(d.get(), d.get(), _modulus.get());
+            fmpz_mul(u.get(), u.get(), d.get());
+            fmpz_mod(u.get(), u.get(), _modulus.get());
+            return _make(u, v);
+        }
+
+        //! @brief factorial() for many n.
+        std::vector<PadicNumber> factorial(std::span<const unsigned_long_t> ns, unsigned threads = 0) const
+        {
+            std::vector<PadicNumber> result(ns.size(), PadicNumber(_ctx, _prec));
+            parallel_for(ns.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    result[i] = factorial(ns[i]);
+                }
+            }, threads);
+            return result;
+        }
+
+        //! @brief binomial() for many (n, k).
+        std::vector<PadicNumber> binomial(std::span<const std::pair<unsigned_long_t, unsigned_long_t>> nks, unsigned threads = 0) const
+        {
+            std::vector<PadicNumber> result(nks.size(), PadicNumber(_ctx, _prec));
+            parallel_for(nks.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t i = begin; i < end; i++)
+                {
+                    result[i] = binomial(nks[i].first, nks[i].second);
+                }
+            }, threads);
+            return result;
+        }
+    };
+
+    //! @brief n! modulo p^prec, see PadicFactorial.
+    PadicNumber factorial_mod(unsigned_long_t n, std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        return PadicFactorial(std::move(ctx), prec).factorial(n);
+    }
+
+    //! @brief binomial(n, k) modulo p^prec, see PadicFactorial.
+    PadicNumber binomial_mod(unsigned_long_t n, unsigned_long_t k, std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC)
+    {
+        return PadicFactorial(std::move(ctx), prec).binomial(n, k);
+    }
+
+    //! @brief binomial(n, k) modulo p^prec for many (n, k), sharing the precomputation.
+    std::vector<PadicNumber> binomial_mod(std::span<const std::pair<unsigned_long_t, unsigned_long_t>> nks, std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned threads = 0)
+    {
+        return PadicFactorial(std::move(ctx), prec).binomial(nks, threads);
+    }
+
+    //! @brief n! modulo p^prec for many n, sharing the precomputation.
+    std::vector<PadicNumber> factorial_mod(std::span<const unsigned_long_t> ns, std::shared_ptr<PadicContext> ctx, signed_long_t prec = PADIC_DEFAULT_PREC, unsigned threads = 0)
+    {
+        return PadicFactorial(std::move(ctx), prec).factorial(ns, threads);
+    }
+
+}
+
+//! @brief Hashes the full value and its precision, consistent with operator==.
+//!        To key on balls across precisions, use PadicBallHash and PadicBallEqual.
+template<>
+struct std::hash<flint::PadicNumber>
+{
+    std::size_t operator()(const flint::PadicNumber& x) const
+    {
+        return flint::_hashMix(flint::hash(x, x.prec()), static_cast<std::uint64_t>(x.prec()));
+    }
+};
+
+template<>
+struct std::hash<flint::Fmpz>
+{
+    std::size_t operator()(const flint::Fmpz& x) const
+    {
+        return flint::hash(x);
+    }
+};